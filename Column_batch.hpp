@@ -0,0 +1,169 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CSV_COLUMN_BATCH_PIERRE_HPP
+#define CSV_COLUMN_BATCH_PIERRE_HPP
+
+#include "tools/parse.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace csv{
+
+//USAGE :
+//Columns of N rows, Arrow style :
+//  text    : one contiguous char buffer, and offsets. Row i is chars[offsets[i], offsets[i+1])
+//  int64   : values, and a validity bitmap (bit i is 0 if row i is empty or cannot be parsed)
+//  float64 : same as int64
+//
+//csv::Column_batch &b = ...;
+//for(size_t i=0;i<b.rows();++i){
+//    std::string_view city = b.columns[0].text(i);
+//    if(b.columns[1].valid(i)){double habs = b.columns[1].f64[i];}
+//}
+
+
+enum class Column_type{text, int64, float64};
+
+
+struct Column_data{
+    std::string name;
+    Column_type type = Column_type::text;
+
+    std::vector<char>     chars;
+    std::vector<uint32_t> offsets{0};
+    std::vector<int64_t>  i64;
+    std::vector<double>   f64;
+    std::vector<uint8_t>  validity;
+
+    std::string_view text (size_t i)const{return std::string_view(chars.data()+offsets[i],offsets[i+1]-offsets[i]);}
+    bool             valid(size_t i)const{return (validity[i/8]>>(i%8)) & 1;}
+
+    //clear data, keep memory
+    void clear(){
+        chars.clear();
+        offsets.resize(1);
+        i64.clear();
+        f64.clear();
+        validity.clear();
+    }
+
+    //append a row
+    void push(std::string_view s, size_t row){
+        switch(type){
+            case Column_type::text:
+                chars.insert(chars.end(),s.begin(),s.end());
+                offsets.push_back(static_cast<uint32_t>(chars.size()));
+                return;
+            case Column_type::int64:{
+                int64_t x=0;
+                set_valid(row, parse(s,x));
+                i64.push_back(x);
+                return;
+            }
+            case Column_type::float64:{
+                double x=0;
+                set_valid(row, parse(s,x));
+                f64.push_back(x);
+                return;
+            }
+        }
+    }
+
+private:
+    template<typename T>
+    static bool parse(std::string_view s, T &x){return csv::parse::value(s,x);} //false if s is empty
+
+    void set_valid(size_t row, bool v){
+        if(row%8==0){validity.push_back(0);}
+        validity.back() |= static_cast<uint8_t>(v)<<(row%8);
+    }
+};
+
+
+class Column_batch{
+public:
+    std::vector<Column_data> columns;
+    std::vector<size_t>      lines; //line number of each row
+
+    size_t rows()const{return lines.size();}
+
+    void clear(){
+        lines.clear();
+        for(auto &c:columns){c.clear();}
+    }
+};
+
+
+
+
+//Batches given to the user return to the pool when released, and are reused.
+//The pool can be destroyed before its batches.
+class Batch_pool{
+    struct State{
+        std::mutex m;
+        std::vector<std::unique_ptr<Column_batch>> free;
+    };
+
+public:
+    struct Recycle{
+        std::shared_ptr<State> state;
+        void operator()(Column_batch *b)const{
+            std::unique_ptr<Column_batch> p(b);
+            if(state==nullptr){return;}
+            p->clear();
+            std::lock_guard<std::mutex> lk(state->m);
+            state->free.push_back(std::move(p));
+        }
+    };
+
+    typedef std::unique_ptr<Column_batch,Recycle> Ptr;
+
+    //a cleared batch, with columns like model (name and type)
+    Ptr acquire(const std::vector<Column_data> &model){
+        std::unique_ptr<Column_batch> b;
+        {
+            std::lock_guard<std::mutex> lk(state->m);
+            if(!state->free.empty()){b=std::move(state->free.back()); state->free.pop_back();}
+        }
+        if(b==nullptr){b=std::make_unique<Column_batch>();}
+
+        if(b->columns.size()!=model.size()){b->columns.resize(model.size());}
+        for(size_t i=0;i<model.size();++i){
+            b->columns[i].name = model[i].name;
+            b->columns[i].type = model[i].type;
+        }
+        return Ptr(b.release(),Recycle{state});
+    }
+
+private:
+    std::shared_ptr<State> state = std::make_shared<State>();
+};
+
+typedef Batch_pool::Ptr Batch_ptr;
+
+
+}
+
+#endif
@@ -19,72 +19,70 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "Csv_reader.hpp"
 #include "tools/str_cat.hpp"
+#include "tools/mmap_file.hpp"
+#include "tools/simd_scan.hpp"
+#include "tools/trim.hpp"
 
 
 
 #include <set>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 
 
-//--- helpers ---
-namespace {
-
-template<typename Fn> //Fn is any callable as void(size_t, std::string&&);
-void tokenize(std::string_view string,  char sep, Fn fn){
-    if(string==""){return;}
-
-    std::string token;
-    size_t index=0;
-    for(char c : string){
-        if(c==sep){
-            fn(index, std::move(token) );
-            token="";
-            ++index;
-        }else{
-            token +=c;
-        }
-    }
-    fn(index,std::move(token) );
+csv::Csv_reader::Column& csv::Csv_reader::find_or_add_column(std::string col_name){
+    auto x = colname_to_fn.try_emplace(std::move(col_name));
+    if(x.second){x.first->second.index = colname_to_fn.size()-1;}
+    return x.first->second;
 }
 
-template<typename Fn> //Fn is any callable as void(size_t, std::string&&);
-void tokenize(std::istream &in,  char sep, char endl, Fn fn){
-    if(!in){return;}
-
-    std::string token;
-    size_t index=0;
-    char c;
-    while (in.get(c)){
-        if(c==endl){fn(index,std::move(token) ); return;}
 
-        if(c==sep){
-            fn(index, std::move(token) );
-            token="";
-            ++index;
-        }else{
-            token +=c;
-        }
-    }
-    fn(index,std::move(token) );
+size_t csv::Csv_reader::add_column_interned(std::string col_name, Fn_interned fn, size_t max_size){
+    Column &c = find_or_add_column(std::move(col_name));
+    c.dict = std::make_unique<Dictionary>(max_size);
+    c.fn   = nullptr;
+    c.fn_view = [d=c.dict.get(),f=std::move(fn)](size_t line, std::string_view token){
+        const uint32_t id = d->intern(token);
+        f(line,id,id!=Dictionary::npos ? (*d)[id] : token);
+        return true;
+    };
+    return c.index;
 }
 
 
+const csv::Dictionary* csv::Csv_reader::dictionary(const std::string &col_name)const{
+    auto x = colname_to_fn.find(col_name);
+    return x!=colname_to_fn.end() ? x->second.dict.get() : nullptr;
+}
 
 
+void csv::Csv_reader::add_filter(std::string col_name, filter::Fn fn){
+    const size_t index = find_or_add_column(col_name).index;
+    filters.push_back(Filter{std::move(col_name),index,std::move(fn)});
+}
 
 
+size_t csv::Csv_reader::add_batch_column(std::string col_name, Column_type type){
+    Column_data d;
+    d.name = col_name;
+    d.type = type;
+    batch_model.push_back(std::move(d));
+    batch_columns.push_back({find_or_add_column(std::move(col_name)).index});
+    return batch_columns.size()-1;
+}
 
 
-}//end namespace {
-
-
-
-
-
-
-void csv::Csv_reader::read_header(std::istream &in){
+void csv::Csv_reader::read_header(){
+    max_fields=SIZE_MAX;
     fn_vector.resize(0);
+    reg_to_col.assign(colname_to_fn.size(),0);
     line_count=0;
 
     std::set<std::string_view> missing_cols;
@@ -94,12 +92,15 @@ void csv::Csv_reader::read_header(std::istream &in){
 
     std::set<std::string> seen_cols;
     std::set<std::string> duplicated_cols;
+    header_names.clear();
 
 
-    auto fn_header = [&,this](size_t , std::string &&h){
+    for(std::string_view v : fields){
+        std::string h(v);
         at_header(h);
 
         missing_cols.erase(h);
+        header_names.push_back(h);
 
         if(seen_cols.count(h)!=0){
             duplicated_cols.insert(h);
@@ -112,9 +113,15 @@ void csv::Csv_reader::read_header(std::istream &in){
             fn_vector.emplace_back( nullptr); //nothing defined
         }else{
             fn_vector.emplace_back( &x->second );
+            reg_to_col[x->second.index] = fn_vector.size()-1;
         }
-    };
-    tokenize(in,sep,endl,fn_header);
+    }
+
+    //projection : don't split after the last registered column
+    if(projection){
+        auto last = std::find_if(fn_vector.rbegin(),fn_vector.rend(),[](const Column *c){return c!=nullptr;});
+        max_fields = static_cast<size_t>(fn_vector.rend()-last);
+    }
 
     //missing columns
     if(!missing_cols.empty()){
@@ -134,62 +141,491 @@ void csv::Csv_reader::read_header(std::istream &in){
         throw std::runtime_error( std::move(err) );
     }
 
+    //filters, in column order
+    active_filters.clear();
+    for(const auto &x:filters){active_filters.push_back(Active_filter{reg_to_col[x.index],&x.fn});}
+    std::stable_sort(active_filters.begin(),active_filters.end(),[](const Active_filter &a, const Active_filter &b){return a.col<b.col;});
+    filter_fields = active_filters.empty() ? 0 : active_filters.back().col+1;
 }
 
 
+bool csv::Csv_reader::getline(std::istream &in){
+    if(!std::getline(in,line_buf,endl)){return false;}
+    if(!quoted){return true;}
+
+    //an endl between quotes doesn't end the line
+    bool in_quote = std::count(line_buf.begin(),line_buf.end(),quote)%2!=0;
+    std::string more;
+    while(in_quote && std::getline(in,more,endl)){
+        line_buf+=endl;
+        line_buf+=more;
+        in_quote = (std::count(more.begin(),more.end(),quote)%2!=0) != in_quote;
+    }
+    return true;
+}
+
+
+template<bool S>
 bool csv::Csv_reader::read_line(std::istream &in){
-    std::string line_str;
-    bool ok= !!std::getline(in,line_str,endl);
+    bool ok= getline(in);
     if(!ok)[[unlikely]]{return false;}
+    split(line_buf);
+    parse_fields<S>(fields.data(),fields.size(),line_buf.size()+1);
+    return true;
+}
+
+
+void csv::Csv_reader::split(std::string_view line){
+    fields.clear();
+    unescaped.used=0;
+    split_fields(line.data(), line.data()+line.size(), fields, unescaped);
+}
+
+
+const char* csv::Csv_reader::split_fields(const char *b, const char *e, std::vector<std::string_view> &out, Unescaped &u, size_t limit)const{
+    const size_t first = out.size();
+    const bool policies = trim_fields || strip_quotes || !null_values.empty();
+    if(!quoted){
+        const char *x = csv::simd::split_line(b,e,sep,endl,out,limit);
+        if(policies){apply_policies(out.data()+first,out.size()-first);}
+        return x;
+    }
+
+    const char *x = csv::simd::split_line_quoted(b,e,sep,endl,quote,out,limit);
+
+    //unquote : "a" => a, "a""b" => a"b.
+    for(size_t i=first; i<out.size(); ++i){
+        std::string_view f = out[i];
+        if(f.empty() || f.front()!=quote){continue;}
+
+        f.remove_prefix(1);
+        if(!f.empty() && f.back()==quote){f.remove_suffix(1);}
+
+        if(f.find(quote)!=std::string_view::npos){
+            //only fields with doubled quotes are copied, buffers are reused
+            if(u.used==u.v.size()){u.v.emplace_back();}
+            std::string &s = u.v[u.used++];
+            s.clear();
+            for(size_t j=0; j<f.size(); ++j){
+                s+=f[j];
+                if(f[j]==quote && j+1<f.size() && f[j+1]==quote){++j;}
+            }
+            f=s;
+        }
+        out[i]=f;
+    }
+    if(policies){apply_policies(out.data()+first,out.size()-first);}
+    return x;
+}
+
+
+//the views are narrowed in place. A null field keeps its position (empty view at its begin)
+void csv::Csv_reader::apply_policies(std::string_view *f, size_t n)const{
+    for(size_t i=0; i<n; ++i){
+        std::string_view v = f[i];
+        if(trim_fields){v=csv::trim(v);}
+        if(strip_quotes && v.size()>=2 && v.front()==quote && v.back()==quote){v=v.substr(1,v.size()-2);}
+        for(const auto &x:null_values){
+            if(v.size()==x.size() && v==x){v=v.substr(0,0); break;}
+        }
+        f[i]=v;
+    }
+}
+
+
+const char* csv::Csv_reader::split_filtered(const char *b, const char *e, Filtered &r){
+    fields.clear();
+    unescaped.used=0;
+    r = Filtered::no;
+    if(active_filters.empty() || filter_fields>=max_fields){return split_fields(b,e,fields,unescaped);}
+
+    const char *x = split_fields(b,e,fields,unescaped,filter_fields);
+    if(!accept(fields.data(),fields.size())){
+        r = Filtered::rejected;
+        return x;
+    }
+    r = Filtered::accepted;
+    fields.clear();
+    unescaped.used=0;
+    return split_fields(b,e,fields,unescaped);
+}
 
+
+template<bool S>
+void csv::Csv_reader::reject_line(size_t bytes){
+    ++line_count;
+    ++filtered_count;
+    offset+=bytes;
+    if constexpr(S){
+        stats->add_line(bytes,0,0);
+        ++stats->lines_filtered;
+    }
+}
+
+
+template<bool S>
+void csv::Csv_reader::parse_fields(const std::string_view *f, size_t n, [[maybe_unused]] size_t bytes, Filtered r){
+    if(r==Filtered::no && !active_filters.empty() && !accept(f,n)){
+        reject_line<S>(bytes);
+        return;
+    }
     ++line_count;
 
-    auto fn_col=[&,this](size_t col, std::string&& token){
-        if(col>= fn_vector.size()){
-            std::string err = "Error in Csv_reader::read_line : too many item in line. line="+std::to_string(line_count)+", extra_token="+token;
+    [[maybe_unused]] Stats::Clock::time_point t0;
+    [[maybe_unused]] size_t given=0;
+    if constexpr(S){t0=Stats::Clock::now();}
+
+    bool ok = true;
+    for(size_t col=0; col<n; ++col){
+        std::string_view token = f[col];
+
+        if(col>=fn_vector.size())[[unlikely]]{
+            line_error(Error_code::too_many_fields,col,f,n,token,nullptr);
+            ok=false;
+            break;
         }
 
         //call function if defined
-        auto pfn = fn_vector[col];
-        if(pfn!=nullptr){
+        auto pc = fn_vector[col];
+        if(pc!=nullptr && (pc->fn_view || pc->fn)){
+            if constexpr(S){++given;}
+            bool r;
             try{
-              at_token(token);
-              (*pfn)(line_count,std::move(token));
+              if(pc->fn_view){
+                  r = pc->fn_view(line_count,token);
+              }else{
+                  std::string s(token);
+                  at_token(s);
+                  r = pc->fn(line_count,std::move(s));
+              }
             }catch(std::exception &e){
-                std::string err = "Error in Csv_reader::read_line : cannot handle token. line="+std::to_string(line_count)+", col="+ std::to_string(col)+", token="+token+", error="+e.what();
-                throw std::runtime_error(std::move(err));
+                line_error(Error_code::callback_throw,col,f,n,token,e.what());
+                ok=false;
+                break;
             }catch(...){
-                std::string err = "Unknown error in Csv_reader::read_line : cannot handle token. line="+std::to_string(line_count)+", col="+ std::to_string(col)+", token="+token;
-                throw std::runtime_error(std::move(err));
+                line_error(Error_code::callback_throw,col,f,n,token,"unknown exception");
+                ok=false;
+                break;
+            }
+            if(!r)[[unlikely]]{
+                line_error(Error_code::callback_false,col,f,n,token,nullptr);
+                ok=false;
+                break;
             }
         }
-    };
+    }
 
-    tokenize(line_str,sep,fn_col);
-    at_line(line_count);
+    if(ok)[[likely]]{
+        if(at_batch){push_batch(f,n);}
+        if(at_row){at_row(Row_view(line_count,f,n,reg_to_col.data(),reg_to_col.size()));}
+        at_line(line_count);
+    }
 
-    return true;
+    if constexpr(S){
+        stats->callbacks += Stats::Clock::now()-t0;
+        stats->add_line(bytes,n,std::max(n,fn_vector.size())-given);
+    }
+    offset+=bytes;
+}
+
+
+struct csv::Csv_reader::Shared_errors{
+    std::atomic<size_t> n{0};
+    std::mutex          at_error_m;
+};
+
+
+void csv::Csv_reader::line_error(Error_code code, size_t col, const std::string_view *f, size_t n, std::string_view token, const char *what){
+    const Error e{line_count,offset,static_cast<uint32_t>(col),code};
+    ++error_n;
+    if(stats!=nullptr){++stats->errors;}
+    const size_t total = shared_errors!=nullptr ? ++shared_errors->n : error_n;
+
+    if(on_error==On_error::throw_error || total>max_errors){
+        std::string err = error_message(e)+", token="+std::string(token);
+        if(what!=nullptr){err+=", error="; err+=what;}
+        if(total>max_errors){err+=", errors="+std::to_string(total)+" > max_errors="+std::to_string(max_errors);}
+        throw std::runtime_error(std::move(err));
+    }
+
+    if(error_v.size()<keep_errors){error_v.push_back(e);}
+    if(on_error==On_error::sink && at_error){
+        const Row_view row(line_count,f,n,reg_to_col.data(),reg_to_col.size());
+        if(shared_errors==nullptr){at_error(e,row); return;}
+        std::lock_guard<std::mutex> lk(shared_errors->at_error_m);
+        at_error(e,row);
+    }
+}
+
+
+std::string csv::Csv_reader::error_message(const Error &e)const{
+    std::string err = "Error in Csv_reader::read : ";
+    switch(e.code){
+        case Error_code::too_many_fields: err+="too many fields in line"; break;
+        case Error_code::callback_false : err+="token rejected by the column function"; break;
+        case Error_code::callback_throw : err+="cannot handle token"; break;
+    }
+    err+=". path="+name+", line="+std::to_string(e.line)+", col="+std::to_string(e.column);
+    if(e.column<header_names.size()){err+=" ("+header_names[e.column]+")";}
+    err+=", offset="+std::to_string(e.offset);
+    return err;
+}
+
+
+void csv::Csv_reader::push_batch(const std::string_view *f, size_t n){
+    if(batch==nullptr){batch=batch_pool.acquire(batch_model);}
+
+    const size_t row = batch->rows();
+    for(size_t i=0;i<batch_columns.size();++i){
+        const size_t c = reg_to_col[batch_columns[i].index];
+        batch->columns[i].push(c<n ? f[c] : std::string_view(), row);
+    }
+    batch->lines.push_back(line_count);
+
+    if(batch->rows()>=batch_rows){
+        Batch_ptr b = std::move(batch); //recycled when at_batch doesn't keep it
+        at_batch(std::move(b));
+    }
+}
 
+
+void csv::Csv_reader::finish(){
+    Batch_ptr b = std::move(batch);
+    if(b!=nullptr && b->rows()!=0){at_batch(std::move(b));}
 }
 
 void csv::Csv_reader::reset(){
     line_count=0;
+    filtered_count=0;
+    offset=0;
+    error_v.clear();
+    error_n=0;
+    pending.clear();
+    header_done=false;
+    max_fields=SIZE_MAX;
     fn_vector.resize(0);
+    batch=nullptr;
+    tail=nullptr;
+}
+
+
+
+const char* csv::Csv_reader::read_header(const char *b, const char *e){
+    fields.clear();
+    unescaped.used=0;
+    const char *x = split_fields(b,e,fields,unescaped);
+    read_header();
+    offset = static_cast<size_t>(x==e ? e-b : x+1-b);
+    return (x==e ? e : x+1);
+}
+
+
+template<bool S>
+void csv::Csv_reader::parse_lines(const char *b, const char *e){
+    //same lines as std::getline : a trailing endl doesn't start a new line
+    while(b!=e){
+        Filtered r;
+        const char *x = split_filtered(b,e,r);
+        const char *n = (x==e ? e : x+1);
+        if(r==Filtered::rejected){reject_line<S>(static_cast<size_t>(n-b));}
+        else{parse_fields<S>(fields.data(),fields.size(),static_cast<size_t>(n-b),r);}
+        b = n;
+    }
+}
+template void csv::Csv_reader::parse_lines<false>(const char *b, const char *e); //Dataset_reader
+
+
+template<bool S>
+const char* csv::Csv_reader::parse_complete(const char *b, const char *e){
+    while(b!=e){
+        Filtered r = Filtered::no;
+        const char *x;
+        if(header_done){
+            x = split_filtered(b,e,r);
+        }else{
+            fields.clear();
+            unescaped.used=0;
+            x = split_fields(b,e,fields,unescaped);
+        }
+        if(x==e){return b;} //no endl : wait for more data
+
+        if(header_done){
+            if(r==Filtered::rejected){reject_line<S>(static_cast<size_t>(x+1-b));}
+            else{parse_fields<S>(fields.data(),fields.size(),static_cast<size_t>(x+1-b),r);}
+        }else{
+            read_header();
+            header_done=true;
+            offset = static_cast<size_t>(x+1-b);
+        }
+        b=x+1;
+    }
+    return e;
 }
 
 
+template<bool S>
+void csv::Csv_reader::parse_block(std::string_view block){
+    const char *b = block.data();
+    const char *e = b+block.size();
+
+    //complete the pending line, one endl at a time (the endl may be quoted)
+    while(!pending.empty() && b!=e){
+        const char *x = static_cast<const char*>(std::memchr(b,endl,static_cast<size_t>(e-b)));
+        if(x==nullptr){
+            pending.append(b,e);
+            return;
+        }
+        pending.append(b,x+1);
+        b=x+1;
+        if(parse_complete<S>(pending.data(),pending.data()+pending.size()) != pending.data()){pending.clear();}
+    }
+
+    const char *tail = parse_complete<S>(b,e);
+    pending.append(tail,e);
+}
+
+
+template<bool S>
+void csv::Csv_reader::parse_end(){
+    if(!header_done){
+        pending.empty() ? fields.clear() : split(pending);
+        read_header();
+        header_done=true;
+    }else if(!pending.empty()){
+        parse_lines<S>(pending.data(),pending.data()+pending.size());
+    }
+    pending.clear();
+}
+
+
+template<bool S>
+size_t csv::Csv_reader::read_read_ahead(const std::filesystem::path &p, Codec c){
+    reset();
+    name=p.generic_string();
+    if constexpr(S){stats->start();}
+
+    //compressed : the thread decompresses the next blocks while this one is parsed
+    std::unique_ptr<csv::Read_ahead> r = c==Codec::none ? std::make_unique<csv::Read_ahead>(p,read_ahead)
+                                                        : std::make_unique<csv::Read_ahead>(decompress_source(p,c),read_ahead,name);
+    pending.reserve(1<<10); //lines cut by a block boundary : grown once, not at each longer line
+    std::string_view block;
+    while(r->next(block)){parse_block<S>(block);}
+    parse_end<S>();
+    finish();
+    if constexpr(S){stats->stop();}
+    return line_count;
+}
+
+
+template<bool S>
+size_t csv::Csv_reader::read_stream(std::istream &in){
+    if constexpr(S){stats->start();}
+
+    if(!getline(in)){line_buf.clear();}
+    split(line_buf);
+    read_header();
+    offset = line_buf.size()+1;
+
+    while(read_line<S>(in)){};
+    finish();
+    if constexpr(S){stats->stop();}
+    return line_count;
+}
+
 
 size_t csv::Csv_reader::read(std::istream &in, const std::string &name_){
     reset();
     name=name_;
+    return stats!=nullptr ? read_stream<true>(in) : read_stream<false>(in);
+}
 
-    read_header(in);
 
-    while(read_line(in)){};
+template<bool S>
+size_t csv::Csv_reader::read_mmap(const std::filesystem::path &p){
+    reset();
+    name=p.generic_string();
+    if constexpr(S){stats->start();}
+
+    csv::Mmap_file f(p);
+    f.advise_sequential();
+    const char *b = f.view().data();
+    const char *e = b+f.view().size();
+    parse_lines<S>(read_header(b,e),e);
+    finish();
+    if constexpr(S){stats->stop();}
     return line_count;
 }
 
+
+template<bool S>
+size_t csv::Csv_reader::read_range_mmap(const std::filesystem::path &p, size_t first_line, size_t last_line){
+    reset();
+    name=p.generic_string();
+    if constexpr(S){stats->start();}
+
+    csv::Mmap_file f(p);
+    const char *b = f.view().data();
+    const char *e = b+f.view().size();
+    const char *x = read_header(b,e);
+
+    //jump to the last indexed line before first_line
+    first_line = std::max<size_t>(first_line,1);
+    const csv::Line_index idx = csv::Line_index::get(p,f.view(),index_step,endl,quoted,quote);
+    const size_t j = std::min(first_line/idx.step, idx.offsets.size()-1);
+    if(j!=0){
+        x = b+idx.offsets[j];
+        line_count = j*idx.step-1; //the line at x is j*step, line 0 is the header
+    }
+
+    //skip the lines before first_line, without splitting them
+    std::vector<std::string_view> none;
+    while(x!=e && line_count+1<first_line){
+        const char *l = quoted ? csv::simd::split_line_quoted(x,e,endl,endl,quote,none,0)
+                               : static_cast<const char*>(std::memchr(x,endl,static_cast<size_t>(e-x)));
+        x = (l==nullptr || l==e) ? e : l+1;
+        ++line_count;
+    }
+    offset = static_cast<size_t>(x-b);
+
+    while(x!=e && line_count<last_line){
+        Filtered r;
+        const char *l = split_filtered(x,e,r);
+        const char *n = (l==e ? e : l+1);
+        if(r==Filtered::rejected){reject_line<S>(static_cast<size_t>(n-x));}
+        else{parse_fields<S>(fields.data(),fields.size(),static_cast<size_t>(n-x),r);}
+        x = n;
+    }
+
+    finish();
+    if constexpr(S){stats->stop();}
+    return line_count;
+}
+
+
+size_t csv::Csv_reader::read_range(const std::filesystem::path &p, size_t first_line, size_t last_line){
+    if(first_line>last_line){
+        throw std::runtime_error("Error in Csv_reader::read_range, first_line > last_line. path="+p.generic_string()+", first_line="+std::to_string(first_line)+", last_line="+std::to_string(last_line) );
+    }
+    check_not_compressed(p,"read_range");
+    return stats!=nullptr ? read_range_mmap<true>(p,first_line,last_line) : read_range_mmap<false>(p,first_line,last_line);
+}
+
+
+void csv::Csv_reader::check_not_compressed(const std::filesystem::path &p, const char *fn)const{
+    const Codec c = codec==Codec::detect ? codec_of_file(p) : codec;
+    if(c!=Codec::none){
+        throw std::runtime_error(std::string("Error in Csv_reader::")+fn+", compressed files ("+codec_name(c)+") can only be read by read(path). path="+p.generic_string() );
+    }
+}
+
+
 size_t csv::Csv_reader::read(const std::filesystem::path &p){
+    const Codec c = codec==Codec::detect ? codec_of_file(p) : codec;
+    if(c!=Codec::none){return stats!=nullptr ? read_read_ahead<true>(p,c) : read_read_ahead<false>(p,c);}
+
+    if(input==Input::mmap       && CSV_HAS_MMAP ){return stats!=nullptr ? read_mmap<true>(p)       : read_mmap<false>(p);}
+    if(input==Input::read_ahead && CSV_HAS_PREAD){return stats!=nullptr ? read_read_ahead<true>(p,Codec::none) : read_read_ahead<false>(p,Codec::none);}
+
     std::ifstream in( p );
     if(!in){
         throw std::runtime_error("Error in Csv_reader::read_file, cannot open file. path="+p.generic_string() );
@@ -197,3 +633,299 @@ size_t csv::Csv_reader::read(const std::filesystem::path &p){
     return read(in,p.generic_string());
 }
 
+
+
+template<bool S>
+size_t csv::Csv_reader::read_tail(){
+    if constexpr(S){stats->start();}
+
+    size_t first = line_count;
+    tail_buf.resize(1<<20);
+    for(;;){
+        size_t n=0;
+        const Tail_file::Status st = tail->read(tail_buf.data(),tail_buf.size(),n);
+        if(st==Tail_file::Status::none){break;}
+        if(st==Tail_file::Status::restart){
+            std::unique_ptr<Tail_file> t = std::move(tail);
+            reset(); //header and lines of the new file
+            tail = std::move(t);
+            first = 0;
+            continue;
+        }
+        parse_block<S>(std::string_view(tail_buf.data(),n));
+    }
+
+    finish();
+    if constexpr(S){stats->stop();}
+    return line_count-first;
+}
+
+
+size_t csv::Csv_reader::read_new(const std::filesystem::path &p){
+    if(tail==nullptr || tail->path()!=p){
+        check_not_compressed(p,"read_new");
+        reset();
+        name=p.generic_string();
+        tail = std::make_unique<Tail_file>(p);
+    }
+    return stats!=nullptr ? read_tail<true>() : read_tail<false>();
+}
+
+
+size_t csv::Csv_reader::follow(const std::filesystem::path &p, const Follow &opt){
+    if(!opt.stop){
+        throw std::runtime_error("Error in Csv_reader::follow, Follow::stop is required. path="+p.generic_string() );
+    }
+    for(;;){
+        read_new(p);
+        if(opt.stop()){break;}
+        tail->wait(opt.poll);
+    }
+    return line_count;
+}
+
+
+
+std::vector<const char*> csv::Csv_reader::chunk_bounds(const char *b, const char *e, size_t chunk_size)const{
+    //quoted : the quote parity tells if x is inside quotes, walk to the next endl outside quotes
+    std::vector<const char*> bounds{b};
+    chunk_size = std::max<size_t>(chunk_size,1);
+    while(static_cast<size_t>(e-bounds.back()) > chunk_size){
+        const char *x = bounds.back()+chunk_size;
+        if(!quoted){
+            x = static_cast<const char*>(std::memchr(x,endl,static_cast<size_t>(e-x)));
+            if(x==nullptr){x=e;}
+        }else{
+            bool in_quote = csv::simd::count(bounds.back(),x,quote)%2!=0;
+            for(;x!=e;++x){
+                if(*x==quote){in_quote=!in_quote;}
+                else if(!in_quote && *x==endl){break;}
+            }
+        }
+        if(x==e || x+1==e){break;}
+        bounds.push_back(x+1);
+    }
+    bounds.push_back(e);
+    return bounds;
+}
+
+
+size_t csv::Csv_reader::count_lines(const char *b, const char *e)const{
+    if(!quoted){
+        return csv::simd::count(b,e,endl) + ( (b!=e && e[-1]!=endl) ? 1 : 0);
+    }
+    size_t n=0;
+    std::vector<std::string_view> none;
+    while(b!=e){
+        const char *x = csv::simd::split_line_quoted(b,e,endl,endl,quote,none,0); //no field : sep is not used
+        ++n;
+        b = (x==e ? e : x+1);
+    }
+    return n;
+}
+
+
+size_t csv::Csv_reader::read_parallel(const std::filesystem::path &p, const Parallel &opt){
+    if(!opt.ordered && !opt.setup){
+        throw std::runtime_error("Error in Csv_reader::read_parallel, unordered read requires Parallel::setup. path="+p.generic_string() );
+    }
+    check_not_compressed(p,"read_parallel");
+
+    reset();
+    name=p.generic_string();
+    if(stats!=nullptr){stats->start();}
+
+    csv::Mmap_file f(p);
+    std::string_view buffer = f.view();
+    const char *b = buffer.data();
+    const char *e = b+buffer.size();
+    b = read_header(b,e);
+
+    const std::vector<const char*> bounds = chunk_bounds(b,e,opt.chunk_size);
+    const size_t n_chunks = bounds.size()-1;
+
+    size_t n_threads = opt.threads!=0 ? opt.threads : std::thread::hardware_concurrency();
+    n_threads = std::clamp<size_t>(n_threads,1,n_chunks);
+
+    //run fn(worker_index) on n_threads threads, rethrow the first exception
+    auto run = [&](auto &&fn){
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(n_threads);
+        for(size_t w=0;w<n_threads;++w){
+            threads.emplace_back([&,w](){
+                try{fn(w);}catch(...){errors[w]=std::current_exception();}
+            });
+        }
+        for(auto &t:threads){t.join();}
+        for(auto &x:errors){if(x){std::rethrow_exception(x);}}
+    };
+
+
+    if(!opt.ordered){
+        //pass 1 : count lines per chunk, prefix sum => first line of each chunk
+        std::vector<size_t> first_line(n_chunks+1,0);
+        std::atomic<size_t> next{0};
+        run([&](size_t){
+            for(size_t k=next++; k<n_chunks; k=next++){first_line[k+1]=count_lines(bounds[k],bounds[k+1]);}
+        });
+        for(size_t k=0;k<n_chunks;++k){first_line[k+1]+=first_line[k];}
+
+        //pass 2 : each worker parses chunks with its own reader
+        std::vector<std::string_view> header = fields;
+        std::atomic<size_t> filtered_total{0};
+        std::mutex          errors_m;
+        Shared_errors       shared;
+        next=0;
+        run([&](size_t w){
+            Csv_reader r(sep,endl);
+            r.quoted    = quoted;
+            r.projection= projection;
+            r.quote     = quote;
+            r.at_header = at_header;
+            r.at_token  = at_token;
+            r.trim_fields  = trim_fields;
+            r.strip_quotes = strip_quotes;
+            r.null_values  = null_values;
+            r.name      = name;
+            r.on_error   = on_error;
+            r.at_error   = at_error;
+            r.max_errors = max_errors;
+            r.keep_errors= keep_errors;
+            r.shared_errors = &shared;
+            for(const auto &x:filters){r.add_filter(x.name,x.fn);}
+            opt.setup(r,w);
+            r.fields    = header;
+            r.read_header();
+
+            for(size_t k=next++; k<n_chunks; k=next++){
+                r.line_count = first_line[k];
+                r.offset     = static_cast<size_t>(bounds[k]-buffer.data());
+                r.parse_lines<false>(bounds[k],bounds[k+1]);
+            }
+            r.finish();
+            filtered_total+=r.filtered_count;
+
+            std::lock_guard<std::mutex> lk(errors_m);
+            error_n+=r.error_n;
+            error_v.insert(error_v.end(),r.error_v.begin(),r.error_v.end());
+        });
+
+        //errors in line order, the first keep_errors
+        std::sort(error_v.begin(),error_v.end(),[](const Error &x, const Error &y){return x.line<y.line;});
+        if(error_v.size()>keep_errors){error_v.resize(keep_errors);}
+        if(error_n>max_errors){
+            throw std::runtime_error("Error in Csv_reader::read_parallel : errors="+std::to_string(error_n)+" > max_errors="+std::to_string(max_errors)+". path="+name);
+        }
+
+        line_count     = first_line[n_chunks];
+        filtered_count = filtered_total;
+        if(stats!=nullptr){
+            //workers have no stats : totals only
+            stats->add_bytes(static_cast<size_t>(e-b));
+            stats->lines = line_count;
+            stats->lines_filtered = filtered_count;
+            stats->errors         = error_n;
+            stats->stop();
+        }
+        return line_count;
+    }
+
+
+    //ordered : workers split chunks into fields, this thread calls the functions in chunk order.
+    //At most window chunks are split in advance.
+    struct Slot{
+        std::vector<std::string_view> fields;
+        std::vector<size_t>           line_end; //line i is fields[line_end[i-1], line_end[i])
+        std::vector<size_t>           line_bytes;
+        Unescaped                     unescaped;
+        size_t                        chunk = SIZE_MAX; //chunk stored in this slot, when ready
+    };
+    const size_t window = 2*n_threads;
+    std::vector<Slot> slots(window);
+
+    std::mutex              m;
+    std::condition_variable cv;
+    size_t next     = 0;     //next chunk to split
+    size_t consumed = 0;     //chunks parsed by this thread
+    bool   stop     = false;
+    std::exception_ptr worker_error;
+
+    std::vector<std::thread> threads;
+    auto stop_workers=[&](){
+        {std::lock_guard<std::mutex> lk(m); stop=true;}
+        cv.notify_all();
+        for(auto &t:threads){t.join();}
+        threads.clear();
+    };
+
+    for(size_t w=0;w<n_threads;++w){
+        threads.emplace_back([&](){
+            try{
+                while(true){
+                    size_t k;
+                    {
+                        std::unique_lock<std::mutex> lk(m);
+                        cv.wait(lk,[&](){return stop || next>=n_chunks || next<consumed+window;});
+                        if(stop || next>=n_chunks){return;}
+                        k=next++;
+                    }
+
+                    Slot &s = slots[k%window];
+                    s.fields.clear();
+                    s.line_end.clear();
+                    s.line_bytes.clear();
+                    s.unescaped.used=0;
+                    const char *cb = bounds[k];
+                    const char *ce = bounds[k+1];
+                    while(cb!=ce){
+                        const char *x = split_fields(cb,ce,s.fields,s.unescaped);
+                        const char *nb = (x==ce ? ce : x+1);
+                        s.line_end.push_back(s.fields.size());
+                        s.line_bytes.push_back(static_cast<size_t>(nb-cb));
+                        cb = nb;
+                    }
+
+                    {std::lock_guard<std::mutex> lk(m); s.chunk=k;}
+                    cv.notify_all();
+                }
+            }catch(...){
+                {std::lock_guard<std::mutex> lk(m); if(!worker_error){worker_error=std::current_exception();} stop=true;}
+                cv.notify_all();
+            }
+        });
+    }
+
+    auto consume=[&](auto with_stats){
+        constexpr bool S = decltype(with_stats)::value;
+        for(size_t k=0;k<n_chunks;++k){
+            Slot &s = slots[k%window];
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv.wait(lk,[&](){return s.chunk==k || worker_error;});
+                if(worker_error){break;}
+            }
+
+            size_t lb=0;
+            for(size_t i=0;i<s.line_end.size();++i){
+                parse_fields<S>(s.fields.data()+lb,s.line_end[i]-lb,s.line_bytes[i]);
+                lb=s.line_end[i];
+            }
+
+            {std::lock_guard<std::mutex> lk(m); consumed=k+1;}
+            cv.notify_all();
+        }
+    };
+
+    try{
+        stats!=nullptr ? consume(std::true_type()) : consume(std::false_type());
+    }catch(...){
+        stop_workers();
+        throw;
+    }
+
+    stop_workers();
+    if(worker_error){std::rethrow_exception(worker_error);}
+    finish();
+    if(stats!=nullptr){stats->stop();}
+    return line_count;
+}
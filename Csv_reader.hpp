@@ -19,13 +19,30 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef CSV_READER_PIERRE_HPP
 #define CSV_READER_PIERRE_HPP
 
+#include "Column_batch.hpp"
+#include "tools/codec.hpp"
+#include "tools/dictionary.hpp"
+#include "tools/filter.hpp"
+#include "tools/line_index.hpp"
+#include "tools/parse.hpp"
+#include "tools/read_ahead.hpp"
+#include "tools/stats.hpp"
+#include "tools/tail_file.hpp"
+
 #include <unordered_map>
 #include <vector>
+#include <memory>
+#include <deque>
+#include <cstdint>
 
 #include <string>
+#include <string_view>
+#include <chrono>
 #include <functional>
+#include <type_traits>
 #include <istream>
 #include <filesystem>
+#include <stdexcept>
 
 
 
@@ -42,11 +59,86 @@ namespace csv{
 //r.add_column("col2",[&](size_t line, std::string&& token){p.second=token;});
 //r.at_line=[&](size_t){v.push_back(p);}
 //
+//Optional : typed columns, the field is parsed from the read buffer without a std::string (see tools/parse.hpp)
+//r.add_column<double>("col4",[&](size_t line, double x){...});
+//r.add_column<std::optional<int64_t>>("col5",[&](size_t line, std::optional<int64_t> x){...}); //empty => nullopt
+//
+//Optional : interned columns, for columns with few distinct values (see tools/dictionary.hpp)
+//r.add_column_interned("country",[&](size_t line, uint32_t id, std::string_view v){count[id]++;}, 100000);
+//r.dictionary("country")->operator[](id); //values by id, kept across reads
+//
+//Optional : keep only the rows where each filter is true, see tools/filter.hpp
+//r.add_filter("status", csv::filter::equal("OK"));
+//r.add_filter("region", csv::filter::in({"EU","US"}));
+//
+//Optional : zero copy columns, the token points into the read buffer
+//and is only valid during the call. at_token is NOT called on these columns.
+//r.add_column("col3",[&](size_t line, std::string_view token){...});
+//
+//Optional : read files with mmap instead of std::ifstream
+//r.input = csv::Csv_reader::Input::mmap;
+//
+//Optional : compressed files (gzip, zstd) are detected and decompressed by read(path), see tools/codec.hpp
+//r.read("something.tsv.gz");
+//
+//Optional : read files with a background thread (pread in a ring of buffers)
+//r.input = csv::Csv_reader::Input::read_ahead;
+//r.read_ahead.buffer_count = 8;
+//r.read_ahead.buffer_size  = 8<<20;
+//r.read_ahead.direct       = true; //O_DIRECT
+//
+//Optional : whole line, fields are views in a buffer reused across lines (no allocation per line)
+//size_t i_col1 = r.add_column("col1");  //no function, i_col1 is the registered index
+//r.at_row=[&](const csv::Row_view &row){ std::string_view col1 = row[i_col1]; ...};
+//
+//Optional : columnar batches of batch_rows rows, see Column_batch.hpp
+//r.add_batch_column("col1");                           //text
+//r.add_batch_column("col2", csv::Column_type::float64);
+//r.at_batch=[&](csv::Batch_ptr &&b){...}; //b returns to the pool when released
+//
+//Optional : quoted fields (RFC 4180), "a,b" => a,b and "a""b" => a"b
+//r.quoted = true;
+//
+//Optional : parse a large file on several threads (uses mmap)
+//csv::Csv_reader::Parallel opt;
+//opt.threads = 8;
+//r.read_parallel("something.tsv", opt);  //ordered : callbacks of r, called in file order
+//
+//opt.ordered = false; //unordered : each worker has its own reader, configured by setup
+//opt.setup   = [&](csv::Csv_reader &w, size_t worker){w.add_column("col1", ...); w.at_line=...;};
+//r.read_parallel("something.tsv", opt);
+//
+//Optional : random access, lines first..last (included, line 1 is the first data line), uses mmap
+//the sparse line index is saved next to the file (something.tsv.idx) and reused while the file is unchanged
+//r.index_step = 1<<16; //one offset every index_step lines
+//r.read_range("something.tsv", 5000000, 5000099);
+//
+//Optional : follow a growing file, see tools/tail_file.hpp
+//r.read_new("growing.tsv"); //only the complete lines appended since the previous call, returns their count
+//csv::Csv_reader::Follow opt;
+//opt.stop = [&](){return done;};
+//r.follow("growing.tsv", opt); //read_new, wait for new data (inotify or poll), until stop returns true
+//
+//Optional : statistics and throttled progress, see tools/stats.hpp
+//csv::Stats s;
+//r.stats = &s;
+//
+//Optional : keep reading after bad lines, see Error. Column functions may return bool (false is an error)
+//r.add_column("col6",[&](size_t line, std::string_view s){return s.size()==3;});
+//r.on_error   = csv::Csv_reader::On_error::skip; //or sink : r.at_error=[&](const csv::Csv_reader::Error &e, const csv::Row_view &row){...}
+//r.max_errors = 1000;                            //more errors => throws
+//for(const auto &e : r.errors()){std::cerr<<r.error_message(e)<<"\n";}
+//
+//Optional : field policies, applied in the tokenizer to the header and to all the fields
+//r.trim_fields  = true;          //"  a " => a
+//r.strip_quotes = true;          //"a" => a
+//r.null_values  = {"NA","NULL"}; //=> empty, std::optional columns get nullopt
+//
 //Optional : simplify column names
-//r.at_header = [](std::string&s){csv::trim(s);}
+//r.at_header = [](std::string&s){...}
 //
-//Optional : simplify tokens
-//r.at_token = [](std::string&s){csv::trim(s);}
+//Optional : simplify tokens (not called on zero copy and typed columns)
+//r.at_token = [](std::string&s){...}
 //
 //--- run parser ---
 //r.read("something.tsv");
@@ -54,24 +146,170 @@ namespace csv{
 
 
 
+//A line of a csv file, given to Csv_reader::at_row.
+//Fields are views in the read buffer, only valid during the call.
+class Row_view{
+public:
+    Row_view()=default;
+    Row_view(size_t line_, const std::string_view *fields_, size_t size_, const size_t *reg_to_col_, size_t reg_count_):
+        line_n(line_),f(fields_),n(size_),reg_to_col(reg_to_col_),reg_count(reg_count_){}
+
+    size_t line()const{return line_n;}
+
+    //fields of the line, in file order
+    size_t size()const{return n;}
+    std::string_view field(size_t i)const{return f[i];}
+    const std::string_view* begin()const{return f;}
+    const std::string_view* end  ()const{return f+n;}
+
+    //field of a registered column, i is the index returned by Csv_reader::add_column. O(1)
+    //returns an empty view if the line is too short.
+    std::string_view operator[](size_t i)const{
+        const size_t c = reg_to_col[i];
+        return c<n ? f[c] : std::string_view();
+    }
+    size_t registered_count()const{return reg_count;}
+
+private:
+    size_t                  line_n     = 0;
+    const std::string_view *f          = nullptr;
+    size_t                  n          = 0;
+    const size_t           *reg_to_col = nullptr;
+    size_t                  reg_count  = 0;
+};
+
+
+
+
 class Csv_reader{
     public:
     typedef std::function<void(size_t line, std::string&&)> Fn_column;
+    typedef std::function<void(size_t line, std::string_view)> Fn_column_view; //token is only valid during the call
     typedef std::function<void(size_t line)> Fn_line; //line 0 is header, line 1 is first data line
+    typedef std::function<void(size_t line, uint32_t id, std::string_view)> Fn_interned; //see add_column_interned
+
+    enum class Error_code : uint8_t{
+        too_many_fields, //the line has more fields than the header (projection=false)
+        callback_false,  //a column function returned false, or add_column<T> cannot parse the token
+        callback_throw   //a column function threw
+    };
+
+    //an error, without message : see error_message
+    struct Error{
+        size_t     line;   //line 1 is the first data line
+        size_t     offset; //byte offset of the begin of the line
+        uint32_t   column; //column in the file
+        Error_code code;
+    };
+
+    enum class On_error{
+        throw_error, //throw at the first error, the message has the token
+        skip,        //skip the line : no at_batch, at_row, at_line, no function of the next columns (functions of the previous columns were called)
+        sink         //same as skip, and call at_error
+    };
+    typedef std::function<void(const Error&, const Row_view&)> Fn_error;
+    typedef std::function<void(const Row_view &row)> Fn_row;
+    typedef std::function<void(Batch_ptr &&batch)> Fn_batch;
+
+    enum class Input{
+        stream, //read(path) uses std::ifstream
+        mmap,   //read(path) maps the file in memory, tokens are never copied for Fn_column_view
+        read_ahead //read(path) reads the file with a background thread, see Read_ahead
+    };
+
+    struct Parallel{
+        size_t threads    = 0;        //number of worker threads, 0 => std::thread::hardware_concurrency()
+        size_t chunk_size = 16<<20;   //bytes per chunk, chunk boundaries are moved to the next endl
+        bool   ordered    = true;
+          //true  : workers split the chunks, the functions of this reader are called in file order by the calling thread
+          //false : workers parse the chunks with their own reader, in any order
+
+        std::function<void(Csv_reader &worker, size_t worker_index)> setup;
+          //unordered only, required : called once per worker, add columns and at_line to worker here.
+          //worker starts with the sep, endl, at_header, at_token and filters of this reader.
+          //Line numbers are the same as a sequential read.
+    };
+
+    struct Follow{
+        std::chrono::milliseconds poll{500}; //longest wait between two reads, inotify wakes up earlier
+        std::function<bool()> stop;          //required : called after each read, true => follow returns
+    };
 
     explicit Csv_reader(char sep_='\t' ,char  endl_='\n'):sep(sep_),endl(endl_){}
 
+    //Fn is callable as void(size_t, std::string_view) => Fn_column_view
+    //otherwise Fn is callable as void(size_t, std::string&&) => Fn_column
+    //Fn may also return bool : false is an error handled by on_error, without exception
+    //returns the registered index of the column, see Row_view
     template<typename Fn>
-    void add_column(std::string col_name, Fn&& fn){
-        colname_to_fn[col_name] = std::forward<Fn>(fn);
+    size_t add_column(std::string col_name, Fn&& fn){
+        Column &c = find_or_add_column(std::move(col_name));
+        if constexpr(std::is_invocable_v<Fn,size_t,std::string_view>){
+            c.fn      = nullptr;
+            c.fn_view = checked<std::string_view>(std::forward<Fn>(fn));
+        }else{
+            c.fn      = checked<std::string&&>(std::forward<Fn>(fn));
+            c.fn_view = nullptr;
+        }
+        return c.index;
     }
 
+    //T is parsed with csv::parse::value (at_token is not called), Fn is callable as void(size_t, T)
+    //a field that cannot be parsed is an error (Error_code::callback_false), use std::optional<T> to accept empty fields
+    template<typename T, typename Fn>
+    size_t add_column(std::string col_name, Fn&& fn){
+        static_assert(std::is_invocable_v<Fn,size_t,T>, "Csv_reader::add_column<T> : fn must be callable as void(size_t, T)");
+        Column &c = find_or_add_column(std::move(col_name));
+        c.fn      = nullptr;
+        c.fn_view = [f=checked<T>(std::forward<Fn>(fn))](size_t line, std::string_view token) mutable {
+            T x{};
+            if(!csv::parse::value(token,x))[[unlikely]]{return false;}
+            return f(line,std::move(x));
+        };
+        return c.index;
+    }
+
+    //each distinct value of the column is copied once in a dictionary, fn gets its id (0, 1, 2 ... in order of
+    //first appearance) and a view valid until the dictionary is cleared. The dictionary is kept across reads.
+    //At most max_size values : other values get id Dictionary::npos and a view only valid during the call.
+    //at_token is not called on this column.
+    size_t add_column_interned(std::string col_name, Fn_interned fn, size_t max_size=SIZE_MAX);
+    const Dictionary* dictionary(const std::string &col_name)const; //nullptr if the column is not interned
+
+    //the column is required. Filters run first, in column order, on the field (field policies applied, not at_token).
+    //A line where one of them is false is skipped : no column function, at_row, at_batch or at_line.
+    //Lines numbers still count skipped lines, see filtered()
+    void add_filter(std::string col_name, filter::Fn fn);
+    size_t filtered()const{return filtered_count;} //lines skipped by the filters during the last read (read_new : since the first call)
+
+    //the column is required, but has no function : use it with at_row
+    size_t add_column(std::string col_name){return find_or_add_column(std::move(col_name)).index;}
+
+    //the column is required and stored in the batches given to at_batch
+    //returns the index of the column in Column_batch::columns
+    size_t add_batch_column(std::string col_name, Column_type type=Column_type::text);
+
     size_t read(std::istream &in, const std::string &name);
     size_t read(const std::filesystem::path &p);
+    size_t read_parallel(const std::filesystem::path &p, const Parallel &opt);
+    size_t read_range(const std::filesystem::path &p, size_t first_line, size_t last_line); //returns the last line read
+
+    //incremental read of a growing file. The offset, the header and the line count are kept between calls,
+    //an incomplete last line waits for the next call. Truncation or replacement of the file : the header is read again.
+    //Any other read forgets this state.
+    size_t read_new(const std::filesystem::path &p); //returns the number of lines read by this call (in the new file after a restart)
+    size_t follow  (const std::filesystem::path &p, const Follow &opt); //returns the line count
 
     Fn_line at_line=[](size_t){};
       //called at the end of each line
 
+    Fn_row at_row=nullptr;
+      //optional, called at the end of each line, before at_line
+
+    Fn_batch at_batch=nullptr;
+    size_t   batch_rows=4096;
+      //optional, called each batch_rows lines, and at the end of the file with the remaining lines
+
     std::function<void(std::string&)> at_header = [](std::string&){};
       //called after reading a header => this is the place to simplify header names
       //for example by removing quotes, triming them ...
@@ -82,17 +320,167 @@ class Csv_reader{
 
     char sep;
     char endl;
+    Input input = Input::stream;
+    Read_ahead::Options read_ahead; //used by Input::read_ahead, and to decompress
+
+    Codec codec = Codec::detect;
+      //read(path) : detect => gzip and zstd files (magic bytes) are decompressed by a Read_ahead thread, whatever input.
+      //none : never, gzip or zstd : always. read_range, read_parallel and read_new don't read compressed files
+
+    bool projection = true;
+      //true : fields after the last registered column are not split, the parser jumps to the next endl.
+      //Row_view::size() is then the last registered column + 1 (at most).
+
+    bool quoted = false; //true : sep and endl between quotes are part of the field, fields are unquoted
+    char quote  = '"';
+
+    //field policies, applied by the tokenizer on the bounds of each field : no copy, no second pass.
+    //In this order : trim_fields, strip_quotes, null_values. The header and the filters see the result.
+    bool trim_fields  = false;            //remove ASCII whitespace around fields, as csv::trim
+    bool strip_quotes = false;            //"a" => a, without the RFC 4180 rules of quoted (doubled quotes are kept)
+    std::vector<std::string> null_values; //a field equal to one of them is empty, e.g. {"NA","NULL"}
+
+    On_error on_error    = On_error::throw_error;
+    Fn_error at_error    = nullptr;  //On_error::sink, called with the line in error
+    size_t   max_errors  = SIZE_MAX; //skip and sink : one more error throws
+      //read_parallel : max_errors counts the errors of all the workers, and at_error is called by one worker at a time,
+      //in any line order when unordered
+    size_t   keep_errors = 1024;     //errors() keeps the first keep_errors errors, error_count() counts all
+
+    const std::vector<Error>& errors()const{return error_v;} //errors of the last read
+    size_t error_count()const{return error_n;}
+    std::string error_message(const Error &e)const;          //built on demand
+
+    Stats *stats = nullptr;
+      //optional : bytes, lines, fields, time in callbacks, progress. nullptr : the parse loop has no measure at all
+
+    size_t index_step = 1<<16;
+      //read_range : lines between two offsets of the Line_index. Smaller : larger index, less lines to skip
 
     private:
+    //column functions, as called by parse_fields : false is an error
+    typedef std::function<bool(size_t line, std::string&&)>    Fn_column_checked;
+    typedef std::function<bool(size_t line, std::string_view)> Fn_column_view_checked;
+
+    //fn as a function that returns bool, a void function always succeeds
+    template<typename Token, typename Fn>
+    static auto checked(Fn&& fn){
+        if constexpr(std::is_same_v<std::invoke_result_t<Fn&,size_t,Token>,bool>){
+            return std::forward<Fn>(fn);
+        }else{
+            return [f=std::forward<Fn>(fn)](size_t line, Token t) mutable {f(line,std::forward<Token>(t)); return true;};
+        }
+    }
+
+    struct Column{
+        Fn_column_checked      fn;
+        Fn_column_view_checked fn_view;
+        size_t         index=0; //registered index
+        std::unique_ptr<Dictionary> dict; //add_column_interned
+    };
+
+    struct Filter{
+        std::string name;
+        size_t     index; //registered index
+        filter::Fn fn;
+    };
+    struct Active_filter{
+        size_t            col; //column in the file
+        const filter::Fn *fn;
+    };
+
+    struct Batch_column{
+        size_t index; //registered index
+    };
+
     std::string name; //used to produce clear error messages
     size_t line_count=0;
-    std::unordered_map<std::string,Fn_column> colname_to_fn;
-    std::vector<Fn_column*> fn_vector;
+    size_t offset=0;  //byte offset of the current line
+    std::vector<std::string> header_names;
+
+    std::vector<Error> error_v;
+    size_t             error_n = 0;
+    struct Shared_errors;                   //unordered read_parallel : error count and at_error of all the workers
+    Shared_errors     *shared_errors = nullptr;
+    //records an error on the current line, or throws. what : message of a caught exception
+    void line_error(Error_code code, size_t col, const std::string_view *f, size_t n, std::string_view token, const char *what);
+    std::unordered_map<std::string,Column> colname_to_fn;
+    std::vector<Column*> fn_vector;
+    std::vector<size_t>  reg_to_col; //registered index => column in the file
+    size_t max_fields = SIZE_MAX;    //fields to split in each line, see projection
+
+    std::vector<Filter>        filters;
+    std::vector<Active_filter> active_filters; //sorted by column, set by read_header
+    size_t filter_fields  = 0;                 //fields to split to run the filters
+    size_t filtered_count = 0;
+    bool accept(const std::string_view *f, size_t n)const{
+        for(const auto &x:active_filters){
+            if(!(*x.fn)(x.col<n ? f[x.col] : std::string_view())){return false;}
+        }
+        return true;
+    }
+
+    std::vector<Batch_column> batch_columns;
+    std::vector<Column_data>  batch_model;
+    Batch_pool                batch_pool;
+    Batch_ptr                 batch;
+    std::string line_buf; //reused by read_line
+    std::vector<std::string_view> fields; //fields of the current line, reused
+
+    //unquoted fields with doubled quotes, buffers are reused
+    struct Unescaped{
+        std::deque<std::string> v; //deque : views stay valid when it grows
+        size_t used=0;
+    };
+    Unescaped unescaped;
 
     //details : read file line by line
-    void read_header(std::istream &in);
-    bool read_line  (std::istream &in);
+    void read_header();   //uses fields
+    bool getline    (std::istream &in); //in => line_buf, quote aware
+    template<bool S> bool   read_line  (std::istream &in);
+    template<bool S> size_t read_stream(std::istream &in);
+    void split(std::string_view line); //line => fields
+    const char* split_fields(const char *b, const char *e, std::vector<std::string_view> &out, Unescaped &u, size_t limit)const; //returns the end of the line
+    const char* split_fields(const char *b, const char *e, std::vector<std::string_view> &out, Unescaped &u)const{return split_fields(b,e,out,u,max_fields);}
+    void apply_policies(std::string_view *f, size_t n)const; //trim_fields, strip_quotes, null_values
+
+    //line at b => fields, returns the end of the line. With filters, the filter columns are split first,
+    //a rejected line is not split further
+    enum class Filtered{no, accepted, rejected};
+    const char* split_filtered(const char *b, const char *e, Filtered &r);
+
+    //call functions on the fields of a line. S : update stats, bytes is the size of the line
+    template<bool S> void parse_fields(const std::string_view *f, size_t n, size_t bytes, Filtered r=Filtered::no);
+    template<bool S> void reject_line(size_t bytes);
+    void push_batch  (const std::string_view *f, size_t n);
+    void finish();  //end of read : flush the last batch
     void reset();
+    Column& find_or_add_column(std::string col_name);
+
+    //details : read blocks of a file, lines may span several blocks
+    std::string pending;      //incomplete line at the end of the previous block
+    bool header_done = false;
+    template<bool S> void parse_block(std::string_view block);
+    template<bool S> void parse_end();
+    template<bool S> const char* parse_complete(const char *b, const char *e); //returns the begin of the incomplete line
+    template<bool S> size_t read_read_ahead(const std::filesystem::path &p, Codec c); //c : none or the codec of the file
+    void check_not_compressed(const std::filesystem::path &p, const char *fn)const; //throws if p is compressed
+
+    //details : read a whole buffer (header included)
+    const char* read_header(const char *b, const char *e); //returns the begin of the first data line
+    template<bool S> void parse_lines(const char *b, const char *e); //e is the end of a line, or the end of the buffer
+    template<bool S> size_t read_mmap(const std::filesystem::path &p);
+    //details : follow a growing file
+    std::unique_ptr<Tail_file> tail; //nullptr : no incremental read in progress
+    std::string tail_buf;
+    template<bool S> size_t read_tail();
+
+    template<bool S> size_t read_range_mmap(const std::filesystem::path &p, size_t first_line, size_t last_line);
+
+    //details : split a buffer of lines for several threads (read_parallel, Dataset_reader)
+    std::vector<const char*> chunk_bounds(const char *b, const char *e, size_t chunk_size)const; //chunk i is [bounds[i],bounds[i+1]), ends after an endl (or at e)
+    size_t count_lines(const char *b, const char *e)const; //same lines as parse_lines
+    friend class Dataset_reader;
 
 };
 
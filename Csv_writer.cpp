@@ -18,6 +18,7 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 
 #include "Csv_writer.hpp"
+#include <algorithm>
 #include <fstream>
 
 
@@ -29,15 +30,33 @@ Csv_writer::Csv_writer(char sep_, char endl_):sep(sep_),endl(endl_){};
 
 Csv_writer::~Csv_writer(){ if(own_out){ try{delete out;}catch(...){} } }
 
+
+void Csv_writer::close_out(){
+    //native : flush and close, out is nullptr
+    if(native){
+        std::unique_ptr<Fd_out> n = std::move(native);
+        n->close();
+    }
+}
+
+
 void Csv_writer::set_write(std::ostream &out_, const std::string &name_){
     auto finally=[&,this](){
         line_count=0;
         own_out = false;
         out = &out_;
         name=name_;
+        if(stats!=nullptr){stats->start();}
         check();
     };
 
+    try{
+        close_out();
+    }catch(...){
+        finally();
+        throw;
+    }
+
     if(own_out){
         try{
             delete out;
@@ -50,16 +69,35 @@ void Csv_writer::set_write(std::ostream &out_, const std::string &name_){
 }
 
 void Csv_writer::set_write(const std::filesystem::path &p){
+    set_write(p,Output::ostream);
+}
+
+
+void Csv_writer::set_write(const std::filesystem::path &p, Output o, size_t preallocate){
 
     auto finally=[&,this](){
         line_count=0;
         name=p.generic_string();
+        if(stats!=nullptr){stats->start();}
+        if(o==Output::native || output_codec(compression,p)!=Codec::none){
+            own_out = false;
+            out     = nullptr;
+            native  = std::make_unique<Fd_out>(p,1<<20,preallocate,compression);
+            return;
+        }
         own_out = true;
         out = new std::ofstream(p);
         if(out==nullptr){throw std::runtime_error("Error in Csv_writer : cannot create new ofstream, name="+name);}
         check();
     };
 
+    try{
+        close_out();
+    }catch(...){
+        finally();
+        throw;
+    }
+
     if(own_out){
         try{
             delete out;
@@ -91,12 +129,13 @@ void Csv_writer::write_header(){
     auto b = std::cbegin(header_v);
     auto e = std::cend  (header_v);
 
-    if(b != e){*out << *(*b); ++b;}
+    if(b != e){put_escaped(*(*b)); ++b;}
     while(b!=e){
-        *out<< sep<< *(*b);
+        put(sep);
+        put_escaped(*(*b));
         ++b;
     }
-    *out << endl;
+    put(endl);
     ++line_count;
     col_count=0;
 }
@@ -106,14 +145,22 @@ void Csv_writer::write_endl(){
     auto b = std::begin(line_v);
     auto e = std::end  (line_v);
 
-    if(b != e){*out << (*b); *b=""; ++b;}
+    auto cell=[this](Cell &c){
+        std::string_view r(arena.data()+c.begin,c.size);
+        c=Cell{};
+        return r;
+    };
+
+    if(b != e){put(cell(*b)); ++b;}
     while(b!=e){
-        *out<< sep<< (*b);
-        *b="";
+        put(sep);
+        put(cell(*b));
         ++b;
     }
+    if(stats!=nullptr){stats->add_line(arena.size()+std::max<size_t>(line_v.size(),1),line_v.size(),0);}
+    arena.clear(); //keeps its capacity
 
-    *out << endl;
+    put(endl);
     ++line_count;
     col_count=0;
 }
@@ -125,6 +172,15 @@ void Csv_writer::write_endl(){
 
 
 void Csv_writer::close(){
+    if(stats!=nullptr){stats->stop();}
+    try{
+        close_out();
+    }catch(...){
+        own_out=false;
+        out=nullptr;
+        throw;
+    }
+
     if(own_out){
         try{
             delete out;
@@ -139,7 +195,8 @@ void Csv_writer::close(){
 
 
     name="<closed "+name+">";
-    std::fill(line_v.begin(), line_v.end(), "");
+    std::fill(line_v.begin(), line_v.end(), Cell{});
+    arena.clear();
     line_count=0;
     col_count=0;
 }
@@ -148,12 +205,14 @@ void Csv_writer::reset(){
     close();
     header_v.clear();
     line_v.clear();
+    precision_v.clear();
 
     colname_to_index.clear();
 }
 
 
 void Csv_writer::check(){
+    if(native){return;} //Fd_out throws on error
     if(!*out){throw std::runtime_error("Error in Csv_writer : cannot write, name="+name);}
 };
 
@@ -27,8 +27,18 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <filesystem>
 
 #include <unordered_map>
+#include <memory>
+#include <charconv>
+#include <sstream>
+#include <type_traits>
+#include <string_view>
 
 #include <cassert>
+#include <cstring>
+
+#include "tools/fd_out.hpp"
+#include "tools/simd_scan.hpp"
+#include "tools/stats.hpp"
 
 namespace csv{
 
@@ -40,6 +50,13 @@ namespace csv{
 //
 // w.set_write("write_here.tsv");
 //
+// //or, bypass std::ostream : buffer + write(2), optional disk preallocation
+// w.set_write("write_here.tsv", csv::Csv_writer::Output::native, 1<<30);
+//
+// //compressed by background threads, from the extension (.gz .zst). Uses Output::native, see tools/codec.hpp
+// w.compression.threads = 4; //optional
+// w.set_write("write_here.tsv.gz");
+//
 //=== write header ===
 // w.write_header();
 //
@@ -72,6 +89,20 @@ namespace csv{
 //--- write a full line, ordered (faster) ---
 // w.write_line("New York","8.33 M");
 //
+//--- statistics ---
+// csv::Stats s;
+// w.stats = &s; //before set_write
+//
+//--- quotes ---
+// w.escape = csv::Csv_writer::Escape::if_needed; //quote tokens that contain sep, endl, quote or '\r'
+//
+//--- numbers ---
+// any write function accepts integers and floating points, formatted with std::to_chars
+// Default : 6 significant digits, the text of std::ostream::operator<<
+// w.set_precision(i_population, 2);                          //optional, fixed with 2 decimals
+// w.set_precision(i_population, csv::precision_round_trip);  //optional, shortest text that reads back the same value
+// w.write_line("New York", 8.33e6);
+//
 //=== colse or recycle writer ===
 //WARNING : don't forget to call reset or set_write
 //if you want to flush data and close ostream before destuctor call
@@ -85,14 +116,31 @@ namespace csv{
 //  w.add_column("fruit_name");
 
 
+//set_precision : digits>=0 is a fixed number of decimals, or one of these
+constexpr int precision_general    = -1; //6 significant digits, as std::ostream::operator<< with default flags (%g)
+constexpr int precision_round_trip = -2; //shortest text that reads back the same value
+
+
 class Csv_writer{
 public:
-    
+
+    enum class Output{
+        ostream, //std::ofstream
+        native   //Fd_out : user space buffer written with write(2)
+    };
+
+    enum class Escape{
+        none,      //tokens are written as they are
+        if_needed, //tokens with sep, endl, quote or '\r' are quoted, quotes are doubled (RFC 4180)
+        always     //all tokens are quoted, quotes are doubled
+    };
+
     Csv_writer(char sep_='\t', char endl_ = '\n');
     ~Csv_writer();
 
     void set_write(std::ostream &out_, const std::string &name_);
     void set_write(const std::filesystem::path &p);
+    void set_write(const std::filesystem::path &p, Output o, size_t preallocate=0);
 
     template<typename Str> size_t add_column(Str &&col_name);
     size_t get_column(const std::string &col_name)const;
@@ -102,22 +150,43 @@ public:
 
     char sep;
     char endl;
+    Escape escape = Escape::none; //also applies to the header
+    char   quote  = '"';
+
+    Stats *stats = nullptr;
+      //optional, see tools/stats.hpp : bytes, lines, fields and progress. Set it before set_write, read it after close.
+
+    Compression compression;
+      //set_write(path) : codec detect => from the extension of the path, see tools/codec.hpp. Bytes of Stats are not compressed
 
+    //Str is a string (anything convertible to std::string_view), a char, a bool, or a number.
+    //Numbers are formatted with std::to_chars : integers, floating points as std::ostream would write them,
+    //or as set by set_precision. Tokens are stored in a per-line arena : no allocation per token.
     template<typename Str> void write_token(const std::string & colname, Str &&tok);
-    template<typename Str> void write_token(size_t col_index,            Str &&tok);
+    template<typename Str> void write_token(size_t col_index,            Str &&tok){set_cell(col_index,std::forward<Str>(tok));}
+
+    //floating points of column col_index are written with digits decimals,
+    //or precision_general (default) or precision_round_trip
+    void set_precision(size_t col_index, int digits){precision_v[col_index]=digits;}
 
 
     // write_tokens(string...)
     void write_tokens(){};
-    template<typename Str>                void write_tokens(Str &&s) {line_v[col_count]=std::forward<Str>(s); ++col_count;};
+    template<typename Str>                void write_tokens(Str &&s) {set_cell(col_count,std::forward<Str>(s)); ++col_count;};
     template<typename... A, typename Str> void write_tokens(Str &&s, A&&... a){write_tokens(std::forward<Str>(s) ); write_tokens(std::forward<A>(a)...);};
 
     // write_tokens(size_t, string...)
     void write_tokens_at(size_t){};
-    template<typename Str>                void write_tokens_at(size_t i, Str&& s){line_v[i]=std::forward<Str>(s);};
+    template<typename Str>                void write_tokens_at(size_t i, Str&& s){set_cell(i,std::forward<Str>(s));};
     template<typename... A, typename Str> void write_tokens_at(size_t i, Str&& s, A&&... a){write_tokens_at(i, std::forward<Str>(s) ); write_tokens_at(i+1, std::forward<A>(a)...);};
 
-    template<typename... A> void write_line(A&&... a){assert( sizeof...(A)==header_v.size() );   write_line_r<false>(std::forward<A>(a)...); *out << endl ;};
+    template<typename... A> void write_line(A&&... a){
+        assert( sizeof...(A)==header_v.size() );
+        if(stats!=nullptr)[[unlikely]]{write_tokens_at(0,std::forward<A>(a)...); write_endl(); return;} //same output, counted by write_endl
+        size_t i=0;
+        (write_direct(i++,std::forward<A>(a)), ...);
+        put(endl);
+    };
 
 
     void reset(); //close if owned, remove columns
@@ -126,22 +195,36 @@ public:
     private:
     std::string name; //used to produce clear error messages
     std::unordered_map<std::string,size_t> colname_to_index;
-    std::vector<std::string> line_v;
+    struct Cell{size_t begin=0; size_t size=0;}; //in arena
+    std::string       arena;  //tokens of the current line, cleared by write_endl
+    std::vector<Cell> line_v;
+    std::vector<int>  precision_v;
     std::vector<const std::string*> header_v;
     size_t line_count=0;
     size_t col_count = 0;
     
     std::ostream * out=nullptr;
     bool own_out = false;
-    
+    std::unique_ptr<Fd_out> native; //Output::native, out is nullptr
+
     void check();
+    void close_out();
 
-    //B=true : write separator before, B=false : don't write separator
-    template<bool B> void write_line_r(){}
-    template<bool B, typename Str >               void write_line_r(Str &&s){if constexpr(B){*out << sep;} *out << std::forward<Str>(s) ; }
-    template<bool B, typename Str, typename... A> void write_line_r(Str &&s, A&&... a){ write_line_r<B>( std::forward<Str>(s) ); write_line_r<true>(std::forward<A>(a)...); };
+    //write to out or native
+    void put(char c){if(native){native->put(c);}else{*out<<c;}}
+    void put(std::string_view s){if(native){native->append(s);}else{*out<<s;}}
 
-    
+    //write s to out or native, following escape
+    void put_escaped(std::string_view s){escape_to(s,[this](auto x){put(x);});}
+
+    //calls put(std::string_view) and put(char) with s, escaped
+    template<typename Put> void escape_to(std::string_view s, Put &&put)const;
+
+    //store a token in the arena
+    template<typename T> void set_cell(size_t i, T &&x);
+
+    //write a token of write_line, with the separator before if i!=0
+    template<typename T> void write_direct(size_t i, T &&x);
 };
 
 }
@@ -155,7 +238,8 @@ size_t csv::Csv_writer::add_column(Str &&col_name){
     auto tmp = colname_to_index.insert({ std::forward<Str>(col_name) ,r});
     if(!tmp.second){throw std::runtime_error("Error in Csv_writer : duplicated column name, colname="+ tmp.first->first +",index="+std::to_string( header_v.size() )+" name="+name);}
     header_v.push_back(&(tmp.first->first) );
-    line_v  .push_back("");
+    line_v  .push_back(Cell{});
+    precision_v.push_back(precision_general);
     return r;
 }
 
@@ -165,12 +249,108 @@ void csv::Csv_writer::write_token(const std::string & colname, Str &&tok){
     if(f==colname_to_index.end()){
         throw std::runtime_error("Error in Csv_writer : wrong column name, colname="+colname+" name="+name);
     }
-    line_v[f->second]=std::forward<Str>(tok);
+    set_cell(f->second,std::forward<Str>(tok));
 }
 
-template<typename Str>
-void csv::Csv_writer::write_token(size_t col_index, Str &&tok){
-    line_v[col_index]=std::forward<Str>(tok);
+
+namespace csv{namespace detail{
+
+//format a bool or a number in [b,b+n) with std::to_chars, returns the end. n must be large enough (format_size)
+//floating points : fixed with precision decimals, precision_general or precision_round_trip
+constexpr size_t format_size = 128;
+
+template<typename X>
+char* format_number(char *b, size_t n, const X &x, int precision){
+    if constexpr(std::is_same_v<X,bool>){
+        *b = x ? '1' : '0';
+        return b+1;
+    }else if constexpr(std::is_floating_point_v<X>){
+        if(precision>=0){
+            auto r = std::to_chars(b,b+n,x,std::chars_format::fixed,precision);
+            if(r.ec==std::errc()){return r.ptr;}
+        }
+        if(precision==precision_round_trip){return std::to_chars(b,b+n,x).ptr;}
+        return std::to_chars(b,b+n,x,std::chars_format::general,6).ptr; //%g, as std::ostream
+    }else{
+        return std::to_chars(b,b+n,x).ptr;
+    }
+}
+
+}}//end csv::detail
+
+
+template<typename T>
+void csv::Csv_writer::set_cell(size_t i, T &&x){
+    typedef std::remove_cv_t<std::remove_reference_t<T>> X;
+    Cell &c = line_v[i];
+    c.begin = arena.size();
+
+    auto append=[this](auto s){arena+=s;};
+
+    if constexpr(std::is_convertible_v<T,std::string_view>){
+        escape_to(std::string_view(x),append);
+    }else if constexpr(std::is_same_v<X,char>){
+        escape_to(std::string_view(&x,1),append);
+    }else if constexpr(std::is_arithmetic_v<X>){
+        char b[detail::format_size];
+        escape_to(std::string_view(b,static_cast<size_t>(detail::format_number(b,detail::format_size,x,precision_v[i])-b)),append);
+    }else{
+        std::string tmp; //anything assignable to a std::string
+        tmp = std::forward<T>(x);
+        escape_to(tmp,append);
+    }
+    c.size = arena.size()-c.begin;
+}
+
+
+template<typename T>
+void csv::Csv_writer::write_direct(size_t i, T &&x){
+    typedef std::remove_cv_t<std::remove_reference_t<T>> X;
+    if(i!=0){put(sep);}
+
+    if constexpr(std::is_convertible_v<T,std::string_view>){
+        put_escaped(std::string_view(x));
+    }else if constexpr(std::is_same_v<X,char>){
+        put_escaped(std::string_view(&x,1));
+    }else if constexpr(std::is_arithmetic_v<X>){
+        char b[detail::format_size];
+        put_escaped(std::string_view(b,static_cast<size_t>(detail::format_number(b,detail::format_size,x,precision_v[i])-b)));
+    }else{
+        std::ostringstream s;
+        s << std::forward<T>(x);
+        put_escaped(std::string_view(s.str()));
+    }
+}
+
+
+template<typename Put>
+void csv::Csv_writer::escape_to(std::string_view s, Put &&put)const{
+    const char *b = s.data();
+    const char *e = b+s.size();
+
+    const char *p = e;
+    switch(escape){
+        case Escape::none      : put(s); return;
+        case Escape::if_needed :
+            p = csv::simd::find_any_of(b,e,sep,endl,quote,'\r');
+            if(p==e)[[likely]]{put(s); return;} //clean field, copied as is
+            break;
+        case Escape::always    :
+            p = b;
+            break;
+    }
+
+    //quote, and double the quotes. Chars before p are not quotes
+    put(quote);
+    for(;;){
+        const char *q = static_cast<const char*>(std::memchr(p,quote,static_cast<size_t>(e-p)));
+        if(q==nullptr){break;}
+        put(std::string_view(b,static_cast<size_t>(q+1-b)));
+        put(quote);
+        b = p = q+1;
+    }
+    put(std::string_view(b,static_cast<size_t>(e-b)));
+    put(quote);
 }
 
 #endif
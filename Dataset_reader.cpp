@@ -0,0 +1,355 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "Dataset_reader.hpp"
+#include "tools/mmap_file.hpp"
+#include "tools/str_cat.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+
+namespace{
+
+//* : any sequence, ? : any character
+bool wildcard_match(std::string_view p, std::string_view s){
+    size_t i=0, j=0;
+    size_t star=std::string_view::npos, mark=0; //last * in p, position in s when it was met
+    while(j<s.size()){
+        if(i<p.size() && (p[i]=='?' || p[i]==s[j])){++i; ++j;}
+        else if(i<p.size() && p[i]=='*'){star=i++; mark=j;}
+        else if(star!=std::string_view::npos){i=star+1; j=++mark;}
+        else{return false;}
+    }
+    while(i<p.size() && p[i]=='*'){++i;}
+    return i==p.size();
+}
+
+}
+
+
+std::vector<std::filesystem::path> csv::Dataset_reader::glob(const std::string &pattern){
+    const std::filesystem::path p(pattern);
+    const std::filesystem::path dir = p.has_parent_path() ? p.parent_path() : std::filesystem::path(".");
+    const std::string name = p.filename().string();
+
+    if(dir.string().find_first_of("*?")!=std::string::npos){
+        throw std::runtime_error("Error in Dataset_reader::glob, wildcards are only allowed in the file name. pattern="+pattern );
+    }
+    if(!std::filesystem::is_directory(dir)){
+        throw std::runtime_error("Error in Dataset_reader::glob, no such directory. pattern="+pattern );
+    }
+
+    std::vector<std::filesystem::path> r;
+    for(const auto &x : std::filesystem::directory_iterator(dir)){
+        if(x.is_regular_file() && wildcard_match(name,x.path().filename().string())){r.push_back(x.path());}
+    }
+    std::sort(r.begin(),r.end());
+    return r;
+}
+
+
+size_t csv::Dataset_reader::read_glob(const std::string &pattern){
+    return read(glob(pattern));
+}
+
+
+size_t csv::Dataset_reader::read(const std::vector<std::filesystem::path> &paths){
+    if(!setup){
+        throw std::runtime_error("Error in Dataset_reader::read, setup is required." );
+    }
+
+    file_v.assign(paths.size(),File_stats());
+    header_v.clear();
+    error_v.clear();
+    error_n=0;
+    steal_n=0;
+    for(size_t i=0;i<paths.size();++i){file_v[i].path=paths[i];}
+    if(paths.empty()){return 0;}
+
+    const size_t n_threads = std::max<size_t>(threads!=0 ? threads : std::thread::hardware_concurrency(),1);
+
+    //workers are configured by this thread. Headers are split and parts are counted with the settings of worker 0
+    std::vector<std::unique_ptr<Csv_reader>> workers;
+    for(size_t w=0;w<n_threads;++w){
+        workers.push_back(std::make_unique<Csv_reader>());
+        setup(*workers.back(),w);
+    }
+
+    //run fn(worker_index) on n_threads threads, the first failure stops the others, rethrow the first exception
+    std::atomic<bool> failed{false};
+    auto run = [&](auto &&fn){
+        std::vector<std::thread> t;
+        std::vector<std::exception_ptr> errors(n_threads);
+        for(size_t w=0;w<n_threads;++w){
+            t.emplace_back([&,w](){
+                try{fn(w);}catch(...){errors[w]=std::current_exception(); failed=true;}
+            });
+        }
+        for(auto &x:t){x.join();}
+        for(auto &x:errors){if(x){std::rethrow_exception(x);}}
+    };
+
+
+    //pass 1 : map the files, split the headers. Compressed files : decompress up to the end of the header
+    struct Shard{
+        Mmap_file f;
+        const char *data = nullptr; //first data line
+        std::vector<std::string> header;
+        Codec codec = Codec::none;  //not none : read by Csv_reader::read, in one part
+        bool  empty = false;
+    };
+    std::vector<Shard> shards(paths.size());
+    std::atomic<size_t> next{0};
+    run([&](size_t){
+        const Csv_reader &r = *workers[0];
+        std::vector<std::string_view> h;
+        Csv_reader::Unescaped u;
+        for(size_t i=next++; i<shards.size() && !failed; i=next++){
+            Shard &s = shards[i];
+            s.codec = r.codec==Codec::detect ? codec_of_file(paths[i]) : r.codec;
+            if(s.codec!=Codec::none){
+                file_v[i].bytes = std::filesystem::file_size(paths[i]);
+                detail::Decoder d(paths[i],s.codec);
+                std::string buf;
+                constexpr size_t step = 64<<10;
+                for(;;){
+                    const size_t old = buf.size();
+                    buf.resize(old+step);
+                    const size_t n = d.read(buf.data()+old,step);
+                    buf.resize(old+n);
+
+                    h.clear();
+                    u.used=0;
+                    const char *e = buf.data()+buf.size();
+                    const char *x = r.split_fields(buf.data(),e,h,u,SIZE_MAX);
+                    if(x!=e || n<step){break;}
+                }
+                s.empty = buf.empty();
+                s.header.assign(h.begin(),h.end());
+                continue;
+            }
+
+            s.f.open(paths[i]);
+            const std::string_view v = s.f.view();
+            file_v[i].bytes = v.size();
+            s.empty = v.empty();
+            if(s.empty){continue;} //no header, no line
+
+            h.clear();
+            u.used=0;
+            const char *e = v.data()+v.size();
+            const char *x = r.split_fields(v.data(),e,h,u,SIZE_MAX);
+            s.header.assign(h.begin(),h.end());
+            s.data = (x==e ? e : x+1);
+        }
+    });
+
+
+    //distinct headers : each one is checked once by every worker
+    std::vector<size_t> current(n_threads,SIZE_MAX); //header mapped by each worker
+    {
+        std::map<std::vector<std::string>,size_t> ids;
+        for(size_t i=0;i<shards.size();++i){
+            if(shards[i].empty){continue;}
+            auto x = ids.emplace(shards[i].header,header_v.size());
+            file_v[i].header = x.first->second;
+            if(!x.second){continue;}
+
+            header_v.push_back(shards[i].header);
+            if(same_header && header_v.size()>1){
+                std::string err = "Error in Dataset_reader::read, the header differs from the header of the first file. path="+paths[i].generic_string()+", header=";
+                csv::str_cat(err,shards[i].header,", ");
+                err+=", first header=";
+                csv::str_cat(err,header_v.front(),", ");
+                throw std::runtime_error(std::move(err));
+            }
+
+            const std::vector<std::string_view> h(header_v.back().begin(),header_v.back().end());
+            for(size_t w=0;w<n_threads;++w){
+                try{
+                    workers[w]->fields = h;
+                    workers[w]->read_header();
+                }catch(std::exception &e){
+                    throw std::runtime_error("Error in Dataset_reader::read, incompatible header. path="+paths[i].generic_string()+", "+e.what());
+                }
+                current[w] = file_v[i].header;
+            }
+        }
+    }
+
+
+    //parts : files larger than split_size are split, their lines are counted for the line numbers. A compressed file is one part
+    struct Part{
+        size_t      file;
+        const char *b;
+        const char *e;
+        size_t      first_line; //line before the first line of the part
+    };
+    std::vector<Part> parts;
+    std::vector<size_t> to_count;
+    for(size_t i=0;i<shards.size();++i){
+        if(shards[i].empty){continue;}
+        if(shards[i].codec!=Codec::none){
+            file_v[i].parts = 1;
+            parts.push_back(Part{i,nullptr,nullptr,0});
+            continue;
+        }
+        const std::string_view v = shards[i].f.view();
+        const std::vector<const char*> bounds = workers[0]->chunk_bounds(shards[i].data,v.data()+v.size(),split_size);
+        file_v[i].parts = bounds.size()-1;
+        for(size_t k=0;k+1<bounds.size();++k){
+            if(bounds.size()>2){to_count.push_back(parts.size());}
+            parts.push_back(Part{i,bounds[k],bounds[k+1],0});
+        }
+    }
+
+    next=0;
+    run([&](size_t){
+        const Csv_reader &r = *workers[0];
+        for(size_t j=next++; j<to_count.size() && !failed; j=next++){
+            Part &p = parts[to_count[j]];
+            p.first_line = r.count_lines(p.b,p.e);
+        }
+    });
+    for(size_t k=0, sum=0; k<parts.size(); ++k){ //counts => prefix sums, per file
+        if(k==0 || parts[k].file!=parts[k-1].file){sum=0;}
+        const size_t n = parts[k].first_line;
+        parts[k].first_line = sum;
+        sum+=n;
+    }
+
+
+    //pass 2 : per-worker queues, largest parts first, dealt in turn. An idle worker steals from the back of another queue.
+    //Compressed files come first : they can't be split
+    struct Queue{
+        std::mutex         m;
+        std::deque<size_t> v;
+    };
+    std::vector<Queue> queues(n_threads);
+    {
+        std::vector<size_t> order(parts.size());
+        for(size_t k=0;k<order.size();++k){order[k]=k;}
+        auto weight = [&](size_t k){
+            const Part &p = parts[k];
+            return p.b==nullptr ? std::make_pair(0,SIZE_MAX-file_v[p.file].bytes) : std::make_pair(1,SIZE_MAX-static_cast<size_t>(p.e-p.b));
+        };
+        std::stable_sort(order.begin(),order.end(),[&](size_t x, size_t y){return weight(x)<weight(y);});
+        for(size_t j=0;j<order.size();++j){queues[j%n_threads].v.push_back(order[j]);}
+    }
+
+    std::atomic<size_t> steals{0};
+    auto take = [&](size_t w, size_t &k){
+        {
+            std::lock_guard<std::mutex> lk(queues[w].m);
+            if(!queues[w].v.empty()){k=queues[w].v.front(); queues[w].v.pop_front(); return true;}
+        }
+        for(size_t i=1;i<n_threads;++i){
+            Queue &q = queues[(w+i)%n_threads];
+            std::lock_guard<std::mutex> lk(q.m);
+            if(!q.v.empty()){k=q.v.back(); q.v.pop_back(); ++steals; return true;}
+        }
+        return false;
+    };
+
+    struct Part_result{
+        size_t lines    = 0;
+        size_t filtered = 0;
+        size_t errors   = 0;
+        std::vector<Csv_reader::Error> error_v;
+        std::chrono::steady_clock::duration time{0};
+    };
+    std::vector<Part_result> results(parts.size());
+
+    run([&](size_t w){
+        Csv_reader &r = *workers[w];
+        std::vector<std::string_view> h;
+        size_t k;
+        size_t last = SIZE_MAX; //file of the previous part : a batch holds the rows of one file
+        while(!failed && take(w,k)){
+            const auto t0 = std::chrono::steady_clock::now();
+            const Part &p = parts[k];
+            const size_t hid = file_v[p.file].header;
+            Part_result &x = results[k];
+            if(p.file!=last){r.finish(); last=p.file;} //before at_part : the batch belongs to the previous file
+
+            if(shards[p.file].codec!=Codec::none){ //whole file : its header, decompression thread. read flushes its last batch
+                if(at_part){at_part(w,p.file);}
+                x.lines    = r.read(paths[p.file]);
+                x.filtered = r.filtered_count;
+                x.errors   = r.error_n;
+                x.error_v.swap(r.error_v);
+                x.time     = std::chrono::steady_clock::now()-t0;
+                current[w] = SIZE_MAX; //read replaced the mapping
+                continue;
+            }
+
+            r.name = paths[p.file].generic_string();
+            if(current[w]!=hid){
+                h.assign(header_v[hid].begin(),header_v[hid].end());
+                r.fields = h;
+                r.read_header();
+                current[w] = hid;
+            }
+            if(at_part){at_part(w,p.file);}
+
+            const size_t filtered0 = r.filtered_count;
+            const size_t errors0   = r.error_n;
+            r.error_v.clear();
+            r.line_count = p.first_line;
+            r.offset     = static_cast<size_t>(p.b-shards[p.file].f.view().data());
+            r.parse_lines<false>(p.b,p.e);
+
+            x.lines    = r.line_count-p.first_line;
+            x.filtered = r.filtered_count-filtered0;
+            x.errors   = r.error_n-errors0;
+            x.error_v.swap(r.error_v);
+            x.time     = std::chrono::steady_clock::now()-t0;
+        }
+        r.finish();
+    });
+    steal_n = steals;
+
+
+    //per file results
+    size_t lines=0;
+    for(size_t k=0;k<parts.size();++k){
+        File_stats        &f = file_v[parts[k].file];
+        const Part_result &x = results[k];
+        f.lines          += x.lines;
+        f.lines_filtered += x.filtered;
+        f.errors         += x.errors;
+        f.seconds        += std::chrono::duration<double>(x.time).count();
+        lines            += x.lines;
+        error_n          += x.errors;
+        for(const auto &e:x.error_v){error_v.push_back(File_error{parts[k].file,e});}
+    }
+    std::sort(error_v.begin(),error_v.end(),[](const File_error &x, const File_error &y){
+        return x.file!=y.file ? x.file<y.file : x.error.line<y.error.line;
+    });
+    if(error_v.size()>keep_errors){error_v.resize(keep_errors);}
+    return lines;
+}
@@ -0,0 +1,114 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CSV_DATASET_READER_PIERRE_HPP
+#define CSV_DATASET_READER_PIERRE_HPP
+
+#include "Csv_reader.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace csv{
+
+//USAGE :
+//csv::Dataset_reader d;
+//d.setup = [&](csv::Csv_reader &w, size_t worker){      //required : called once per worker, by the calling thread
+//    w.sep = '\t';
+//    w.add_column("city",[&ctx=contexts[worker]](size_t line, std::string_view s){...});
+//    w.at_line = [&ctx=contexts[worker]](size_t line){...};
+//};
+//d.at_part = [&](size_t worker, size_t file){contexts[worker].file=file;}; //optional
+//size_t n = d.read_glob("/data/2024-06-01/*.tsv");       //or d.read({path1, path2, ...})
+//for(const auto &f : d.files()){std::cout<<f.path<<" "<<f.lines<<" "<<f.seconds<<"\n";}
+//
+//Each shard is read as Csv_reader::read would read it alone : its own header, line numbers from 1.
+//Headers may differ between shards (column order, extra columns) as long as every worker finds its columns :
+//each distinct header is checked once before any callback. same_header = true requires identical headers.
+//
+//Files larger than split_size are split into parts of about split_size bytes (the lines of each part are counted
+//first, so that line numbers stay exact). Parts are dealt to per-worker queues, largest first.
+//A worker that empties its queue steals from the other queues : one large shard doesn't leave the other threads idle.
+//
+//Compressed files (gzip, zstd, see Csv_reader::codec) are not split : each one is a part, read by Csv_reader::read
+//with a decompression thread, and dealt before the other parts.
+//
+//Callbacks of a worker are called by one thread, in the order of its parts. Parts of a file may be parsed
+//by several workers at the same time, in any order.
+//Batches (Csv_reader::at_batch) hold the rows of one file : a worker flushes its batch before a part of another file,
+//so the file of a batch is the one given to the last at_part of the worker.
+//Other files are read with mmap. Worker stats (Csv_reader::stats) are not used : see files().
+
+class Dataset_reader{
+public:
+    typedef std::function<void(Csv_reader &worker, size_t worker_index)> Fn_setup;
+    typedef std::function<void(size_t worker_index, size_t file)>      Fn_part;
+
+    struct File_stats{
+        std::filesystem::path path;
+        size_t bytes          = 0; //file size, header included (compressed size)
+        size_t lines          = 0; //data lines
+        size_t lines_filtered = 0; //see Csv_reader::add_filter, included in lines
+        size_t errors         = 0; //see Csv_reader::on_error, included in lines
+        size_t parts          = 0; //ranges of lines parsed separately
+        size_t header         = 0; //index in headers()
+        double seconds        = 0; //worker time on this file, all parts
+    };
+
+    struct File_error{
+        size_t           file; //index in files()
+        Csv_reader::Error error;
+    };
+
+    Fn_setup setup;           //required
+    Fn_part  at_part=nullptr; //optional, called by a worker before each part of a file
+
+    size_t threads     = 0;       //0 => std::thread::hardware_concurrency()
+    size_t split_size  = 64<<20;  //files larger than this are split into parts of about split_size bytes
+    bool   same_header = false;   //true : every shard must have the header of the first shard
+    size_t keep_errors = 1024;    //errors() keeps the first keep_errors errors, in file and line order
+
+    size_t read(const std::vector<std::filesystem::path> &paths); //returns the number of data lines of all the files
+    size_t read_glob(const std::string &pattern);                 //read(glob(pattern))
+
+    //files of a directory whose name matches pattern, sorted. Wildcards (* ?) only in the file name : "data/part-*.tsv"
+    static std::vector<std::filesystem::path> glob(const std::string &pattern);
+
+    //results of the last read
+    const std::vector<File_stats>&               files  ()const{return file_v;}   //same order as the paths
+    const std::vector<std::vector<std::string>>& headers()const{return header_v;} //distinct headers, as split (before at_header)
+    const std::vector<File_error>&               errors ()const{return error_v;}
+    size_t error_count()const{return error_n;}
+    size_t steals()const{return steal_n;} //parts taken from the queue of another worker
+
+private:
+    std::vector<File_stats>               file_v;
+    std::vector<std::vector<std::string>> header_v;
+    std::vector<File_error>               error_v;
+    size_t error_n = 0;
+    size_t steal_n = 0;
+};
+
+
+}
+
+#endif
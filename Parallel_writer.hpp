@@ -0,0 +1,478 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CSV_PARALLEL_WRITER_PIERRE_HPP
+#define CSV_PARALLEL_WRITER_PIERRE_HPP
+
+#include "Csv_writer.hpp"
+#include "tools/fd_out.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+
+namespace csv{
+
+//USAGE :
+//=== define writer (one thread) ===
+// csv::Parallel_writer w;
+// w.add_column("city");
+// w.add_column("population");
+// w.set_write("write_here.tsv");                     //any order
+// //w.set_write("write_here.tsv", {.order=csv::Parallel_writer::Order::sequence});
+// w.write_header();
+//
+//=== write data (any number of threads) ===
+// //in each thread
+// csv::Parallel_writer::Producer p = w.producer();
+// p.write_line("New York", 8.33e6);
+//
+// //Order::sequence : the lines written since the previous submit form the block seq.
+// //Blocks are written in the order 0,1,2... whatever thread submits them.
+// p.write_line("New York", 8.33e6);
+// p.submit(seq);
+//
+//=== close (one thread, after all producers are destroyed) ===
+// w.close(); //throws on error
+//
+//Each producer formats its lines in its own buffer. Full buffers (or submitted blocks) are pushed on a
+//lock free list, a single flusher thread writes them with write(2) and gives them back to their producer.
+//Order::any : a producer has at most max_blocks buffers, it waits for the flusher when they are all in use.
+//Order::sequence : blocks wait in memory until the previous ones are written.
+
+
+class Parallel_writer{
+    struct State;
+
+public:
+    enum class Order{
+        any,     //blocks are written when they are full, lines of a producer stay in order
+        sequence //blocks are written by increasing sequence number, starting at 0, without gap or duplicate (close throws)
+    };
+
+    struct Options{
+        Order  order       = Order::any;
+        size_t buffer_size = 1<<20; //a producer hands its buffer to the flusher when it is that large
+        size_t max_blocks  = 4;     //buffers per producer, Order::any only
+        size_t preallocate = 0;     //bytes, see Fd_out
+        Compression compression;    //see codec.hpp. codec detect : from the extension of the path (.gz .zst)
+    };
+
+    class Producer{
+    public:
+        Producer(Producer &&o)noexcept:w(o.w),s(o.s){o.w=nullptr; o.s=nullptr;}
+        Producer& operator=(Producer &&o)noexcept{std::swap(w,o.w); std::swap(s,o.s); return *this;}
+        ~Producer(){release();}
+
+        template<typename... A> void write_line(A&&... a);
+
+        //Order::any : hand the buffer to the flusher now
+        void flush();
+
+        //Order::sequence : the lines written since the previous submit are the block seq
+        void submit(size_t seq);
+
+    private:
+        friend class Parallel_writer;
+        Producer(Parallel_writer *w_, State *s_):w(w_),s(s_){}
+
+        Parallel_writer *w;
+        State           *s;
+
+        template<typename T> void put(size_t i, T &&x);
+        void release();
+    };
+
+
+    Parallel_writer(char sep_='\t', char endl_ = '\n'):sep(sep_),endl(endl_){}
+    ~Parallel_writer(); //close without throwing. Producers still alive : their lines so far are written, see close
+
+    Parallel_writer(const Parallel_writer&)=delete;
+    Parallel_writer& operator=(const Parallel_writer&)=delete;
+
+    //starts the flusher thread
+    void set_write(const std::filesystem::path &p){set_write(p,Options());}
+    void set_write(const std::filesystem::path &p, const Options &opt);
+
+    template<typename Str> size_t add_column(Str &&col_name);
+    size_t get_column(const std::string &col_name)const;
+
+    //floating points of column col_index are written with digits decimals,
+    //or precision_general (default) or precision_round_trip : the same text as Csv_writer
+    void set_precision(size_t col_index, int digits){precision_v[col_index]=digits;}
+
+    //call it before creating the first producer
+    void write_header();
+
+    //thread safe. Columns, precision, sep and endl must not change while producers exist
+    Producer producer();
+
+    //all producers must be destroyed (else throws, and the file stays open). Waits for the flusher, closes the file, throws on error
+    void close();
+
+    char sep;
+    char endl;
+
+private:
+    struct Block{
+        Block      *next  = nullptr;
+        State      *owner = nullptr;
+        size_t      seq   = 0;
+        std::string data;
+    };
+
+    //a producer, kept until the writer is destroyed : the flusher can always give back a block
+    struct State{
+        std::atomic<Block*>                 returned{nullptr}; //pushed by the flusher
+        std::vector<std::unique_ptr<Block>> blocks;            //all blocks of this state
+        std::vector<Block*>                 free;              //owned by the producer
+        Block                              *cur = nullptr;
+    };
+
+    std::string name; //used to produce clear error messages
+    std::unordered_map<std::string,size_t> colname_to_index;
+    std::vector<const std::string*>        header_v;
+    std::vector<int>                       precision_v;
+
+    Options                              opt;
+    std::unique_ptr<Fd_out>              out;
+    std::thread                          flusher;
+    std::atomic<Block*>                  head{nullptr}; //lock free MPSC stack, pushed by producers
+    Block                                stop_block;    //pushed by close
+    std::atomic<bool>                    failed{false};
+    std::exception_ptr                   error;         //written by the flusher, read after join
+
+    std::mutex                           states_m;
+    std::vector<std::unique_ptr<State>>  states;
+    std::vector<State*>                  free_states;
+    size_t                               live = 0;      //producers
+    bool                                 started = false;
+
+    static void push(std::atomic<Block*> &stack, Block *b){
+        Block *h = stack.load(std::memory_order_relaxed);
+        do{ b->next = h; }while(!stack.compare_exchange_weak(h,b,std::memory_order_release,std::memory_order_relaxed));
+        stack.notify_one();
+    }
+
+    Block* acquire(State &s);
+    void   hand_off(State &s, size_t seq);
+    void   run();
+    void   write(Block *b);
+    void   stop(); //push stop_block, join the flusher
+};
+
+
+
+
+template<typename Str>
+size_t Parallel_writer::add_column(Str &&col_name){
+    size_t r = header_v.size();
+    auto tmp = colname_to_index.insert({ std::forward<Str>(col_name) ,r});
+    if(!tmp.second){throw std::runtime_error("Error in Parallel_writer : duplicated column name, colname="+ tmp.first->first +",index="+std::to_string( header_v.size() )+" name="+name);}
+    header_v.push_back(&(tmp.first->first) );
+    precision_v.push_back(precision_general);
+    return r;
+}
+
+
+inline size_t Parallel_writer::get_column(const std::string &col_name)const{
+    auto f = colname_to_index.find(col_name);
+    if(f==colname_to_index.end()){
+        throw std::runtime_error("Error in Parallel_writer : the column doesn't exists, colname="+col_name+", name="+name);
+    }
+    return f->second;
+}
+
+
+inline void Parallel_writer::set_write(const std::filesystem::path &p, const Options &opt_){
+    close();
+    name = p.generic_string();
+    opt  = opt_;
+    opt.buffer_size = std::max<size_t>(opt.buffer_size,1);
+    opt.max_blocks  = std::max<size_t>(opt.max_blocks,1);
+    out  = std::make_unique<Fd_out>(p,1<<20,opt.preallocate,opt.compression);
+    failed.store(false);
+    error   = nullptr;
+    started = false;
+    flusher = std::thread([this](){run();});
+}
+
+
+inline void Parallel_writer::write_header(){
+    if(out==nullptr){throw std::runtime_error("Error in Parallel_writer::write_header : call set_write first, name="+name);}
+    if(started     ){throw std::runtime_error("Error in Parallel_writer::write_header : producers already exist, name="+name);}
+
+    //no block was pushed yet : the flusher doesn't use out
+    for(size_t i=0;i<header_v.size();++i){
+        if(i!=0){out->put(sep);}
+        out->append(*header_v[i]);
+    }
+    out->put(endl);
+}
+
+
+inline Parallel_writer::Producer Parallel_writer::producer(){
+    if(out==nullptr){throw std::runtime_error("Error in Parallel_writer::producer : call set_write first, name="+name);}
+
+    std::lock_guard<std::mutex> lk(states_m);
+    started=true;
+    ++live;
+    if(free_states.empty()){
+        states.push_back(std::make_unique<State>());
+        return Producer(this,states.back().get());
+    }
+    State *s = free_states.back();
+    free_states.pop_back();
+    return Producer(this,s);
+}
+
+
+inline Parallel_writer::Block* Parallel_writer::acquire(State &s){
+    for(;;){
+        if(s.free.empty()){
+            for(Block *b = s.returned.exchange(nullptr,std::memory_order_acquire); b!=nullptr; b=b->next){s.free.push_back(b);}
+        }
+        if(!s.free.empty()){
+            Block *b = s.free.back();
+            s.free.pop_back();
+            return b;
+        }
+        //Order::sequence never waits : a missing block may be held by this producer
+        if(opt.order==Order::sequence || s.blocks.size()<opt.max_blocks){
+            s.blocks.push_back(std::make_unique<Block>());
+            Block *b = s.blocks.back().get();
+            b->owner = &s;
+            b->data.reserve(opt.buffer_size+detail::format_size);
+            return b;
+        }
+        s.returned.wait(nullptr,std::memory_order_acquire);
+    }
+}
+
+
+inline void Parallel_writer::hand_off(State &s, size_t seq){
+    if(failed.load(std::memory_order_relaxed)){
+        s.cur->data.clear();
+        throw std::runtime_error("Error in Parallel_writer : cannot write, name="+name);
+    }
+    Block *b = s.cur;
+    s.cur  = nullptr;
+    b->seq = seq;
+    push(head,b);
+}
+
+
+inline void Parallel_writer::write(Block *b){
+    if(!failed.load(std::memory_order_relaxed)){
+        try{
+            out->append(b->data);
+        }catch(...){
+            error = std::current_exception();
+            failed.store(true,std::memory_order_relaxed);
+        }
+    }
+    b->data.clear();
+    push(b->owner->returned,b);
+}
+
+
+inline void Parallel_writer::run(){
+    std::map<size_t,Block*> pending; //Order::sequence
+    size_t next_seq = 0;
+    std::vector<Block*> v;
+
+    for(;;){
+        Block *l = head.exchange(nullptr,std::memory_order_acquire);
+        if(l==nullptr){
+            head.wait(nullptr,std::memory_order_acquire);
+            continue;
+        }
+
+        //the stack is LIFO, restore the push order
+        v.clear();
+        for(;l!=nullptr;l=l->next){v.push_back(l);}
+
+        for(auto it=v.rbegin();it!=v.rend();++it){
+            Block *b = *it;
+            if(b==&stop_block){
+                //close is called after all producers are destroyed : nothing after stop_block
+                for(auto &x:pending){write(x.second);}
+                if(!pending.empty() && !failed.load()){
+                    error = std::make_exception_ptr(std::runtime_error("Error in Parallel_writer::close : missing block, seq="+std::to_string(next_seq)+", name="+name));
+                    failed.store(true);
+                }
+                try{
+                    if(error==nullptr){out->flush();}
+                }catch(...){
+                    error = std::current_exception();
+                    failed.store(true);
+                }
+                return;
+            }
+
+            if(opt.order==Order::any){write(b); continue;}
+
+            if(b->seq<next_seq || !pending.emplace(b->seq,b).second){
+                //already written or pending : close throws, the block is given back
+                if(!failed.load()){
+                    error = std::make_exception_ptr(std::runtime_error("Error in Parallel_writer::close : duplicate sequence number, seq="+std::to_string(b->seq)+", name="+name));
+                    failed.store(true);
+                }
+                write(b);
+                continue;
+            }
+            while(!pending.empty() && pending.begin()->first==next_seq){
+                write(pending.begin()->second);
+                pending.erase(pending.begin());
+                ++next_seq;
+            }
+        }
+    }
+}
+
+
+inline Parallel_writer::~Parallel_writer(){
+    //close throws before joining when producers still exist : the flusher must not outlive the writer
+    try{close();}catch(...){}
+    if(flusher.joinable()){stop();}
+}
+
+
+inline void Parallel_writer::stop(){
+    push(head,&stop_block);
+    flusher.join();
+    head.store(nullptr);
+}
+
+
+inline void Parallel_writer::close(){
+    if(out==nullptr){return;}
+    {
+        std::lock_guard<std::mutex> lk(states_m);
+        if(live!=0){throw std::runtime_error("Error in Parallel_writer::close : "+std::to_string(live)+" producers still exist, name="+name);}
+    }
+
+    stop();
+
+    std::unique_ptr<Fd_out> o = std::move(out);
+    std::exception_ptr      e = error;
+    error = nullptr;
+    name  = "<closed "+name+">";
+
+    //blocks are owned by states
+    free_states.clear();
+    states.clear();
+
+    if(e){
+        try{o->close();}catch(...){}
+        std::rethrow_exception(e);
+    }
+    o->close();
+}
+
+
+
+
+template<typename... A>
+void Parallel_writer::Producer::write_line(A&&... a){
+    assert( sizeof...(A)==w->header_v.size() );
+    if(s->cur==nullptr){s->cur=w->acquire(*s);}
+
+    size_t i=0;
+    (put(i++,std::forward<A>(a)), ...);
+    s->cur->data.push_back(w->endl);
+
+    if(w->opt.order==Order::any && s->cur->data.size()>=w->opt.buffer_size){w->hand_off(*s,0);}
+}
+
+
+template<typename T>
+void Parallel_writer::Producer::put(size_t i, T &&x){
+    typedef std::remove_cv_t<std::remove_reference_t<T>> X;
+    std::string &d = s->cur->data;
+    if(i!=0){d.push_back(w->sep);}
+
+    if constexpr(std::is_convertible_v<T,std::string_view>){
+        d.append(std::string_view(x));
+    }else if constexpr(std::is_same_v<X,char>){
+        d.push_back(x);
+    }else if constexpr(std::is_arithmetic_v<X>){
+        const size_t n = d.size();
+        d.resize(n+detail::format_size);
+        d.resize(static_cast<size_t>(detail::format_number(d.data()+n,detail::format_size,x,w->precision_v[i])-d.data()));
+    }else{
+        std::ostringstream o;
+        o << std::forward<T>(x);
+        d.append(o.str());
+    }
+}
+
+
+inline void Parallel_writer::Producer::flush(){
+    if(w->opt.order!=Order::any){throw std::runtime_error("Error in Parallel_writer::Producer::flush : use submit with Order::sequence, name="+w->name);}
+    if(s->cur==nullptr || s->cur->data.empty()){return;}
+    w->hand_off(*s,0);
+}
+
+
+inline void Parallel_writer::Producer::submit(size_t seq){
+    if(w->opt.order!=Order::sequence){throw std::runtime_error("Error in Parallel_writer::Producer::submit : use flush with Order::any, name="+w->name);}
+    if(s->cur==nullptr){s->cur=w->acquire(*s);} //an empty block still has a sequence number
+    w->hand_off(*s,seq);
+}
+
+
+inline void Parallel_writer::Producer::release(){
+    if(w==nullptr){return;}
+
+    //Order::any : write the rest. Order::sequence : lines not submitted are dropped
+    if(s->cur!=nullptr){
+        if(w->opt.order==Order::any && !s->cur->data.empty()){
+            try{w->hand_off(*s,0);}catch(...){} //close reports the error
+        }
+        if(s->cur!=nullptr){
+            s->cur->data.clear();
+            s->free.push_back(s->cur);
+            s->cur=nullptr;
+        }
+    }
+
+    std::lock_guard<std::mutex> lk(w->states_m);
+    w->free_states.push_back(s);
+    --w->live;
+    w=nullptr;
+    s=nullptr;
+}
+
+
+}
+
+#endif
@@ -0,0 +1,249 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CSV_ROWS_PIERRE_HPP
+#define CSV_ROWS_PIERRE_HPP
+
+#include "tools/simd_scan.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace csv{
+
+//USAGE :
+//for(const auto &row : csv::rows("something.tsv", '\t')){
+//    std::string_view a = row[0];
+//    if(a=="stop"){break;} //no more read
+//}
+//
+//csv::Rows r = csv::rows("something.csv", ',');
+//const size_t i_city = r.column("city");   //index of a column of the header
+//for(const auto &row : r | std::views::filter([&](const csv::Rows::Row &x){return x[i_city]=="Paris";})
+//                        | std::views::take(10)){...}
+//
+//Options : csv::Rows::Options opt; opt.quoted=true; ... csv::rows("something.csv", opt);
+//
+//Rows is a std::ranges::input_range : a single pass, the file is read by blocks while iterating.
+//Fields are views in the block buffer : they are only valid until the next row.
+//Same lines as Csv_reader : line 1 is the first data line, a trailing endl doesn't start a new line.
+//The parser is a plain object : no std::function or virtual call in the loop.
+
+
+class Rows{
+public:
+    struct Options{
+        char   sep         = '\t';
+        char   endl        = '\n';
+        bool   quoted      = false; //true : sep and endl between quotes are part of the field, fields are unquoted
+        char   quote       = '"';
+        bool   header      = true;  //the first line is the header, see header() and column()
+        size_t buffer_size = 1<<20; //grows if a line is longer
+    };
+
+
+    class Row{
+    public:
+        size_t line()const{return line_n;}
+        size_t size()const{return f->size();}
+        std::string_view operator[](size_t i)const{return i<f->size() ? (*f)[i] : std::string_view();} //empty if the line is too short
+        auto begin()const{return f->begin();}
+        auto end  ()const{return f->end();}
+
+    private:
+        friend class Rows;
+        size_t line_n = 0;
+        const std::vector<std::string_view> *f = nullptr;
+    };
+
+
+    class iterator{
+    public:
+        typedef std::input_iterator_tag iterator_concept;
+        typedef std::input_iterator_tag iterator_category;
+        typedef Row                     value_type;
+        typedef std::ptrdiff_t          difference_type;
+
+        iterator()=default;
+        const Row& operator* ()const{return r->row;}
+        const Row* operator->()const{return &r->row;}
+        iterator& operator++(){if(!r->next()){r=nullptr;} return *this;}
+        void      operator++(int){++*this;}
+        friend bool operator==(const iterator &i, std::default_sentinel_t){return i.r==nullptr;}
+
+    private:
+        friend class Rows;
+        explicit iterator(Rows *r_):r(r_){}
+        Rows *r = nullptr; //nullptr : end
+    };
+
+
+    Rows(const std::filesystem::path &p, const Options &opt_);
+
+    Rows(Rows&&)=default;
+    Rows& operator=(Rows&&)=default;
+
+    //parses the first row. Only one pass : call it once
+    iterator begin(){return iterator(next() ? this : nullptr);}
+    std::default_sentinel_t end()const{return {};}
+
+    const std::vector<std::string>& header()const{return header_v;}
+    size_t column(std::string_view col_name)const; //throws if col_name is not in the header
+
+private:
+    Options       opt;
+    std::string   name;
+    std::ifstream in;
+    std::unique_ptr<char[]> buf;
+    size_t        cap  = 0;
+    size_t        pos  = 0; //begin of the next line
+    size_t        stop = 0; //end of the data in buf
+    bool          eof  = false;
+
+    size_t                        line_count = 0;
+    std::vector<std::string_view> fields;
+    std::deque<std::string>       unescaped; //fields with doubled quotes. deque : views stay valid when it grows
+    size_t                        unescaped_used = 0;
+    std::vector<std::string>      header_v;
+    Row                           row;
+
+    bool next();   //next line => row, false at the end
+    bool refill(); //keeps [pos,stop), reads more. false : nothing more to read
+    void unquote();
+};
+
+
+inline Rows rows(const std::filesystem::path &p, const Rows::Options &opt){return Rows(p,opt);}
+
+inline Rows rows(const std::filesystem::path &p, char sep='\t', char endl='\n'){
+    Rows::Options opt;
+    opt.sep  = sep;
+    opt.endl = endl;
+    return Rows(p,opt);
+}
+
+
+
+
+inline Rows::Rows(const std::filesystem::path &p, const Options &opt_):
+    opt(opt_),name(p.generic_string()),in(p,std::ios::binary),cap(std::max<size_t>(opt_.buffer_size,64))
+{
+    if(!in){throw std::runtime_error("Error in csv::Rows, cannot open file. path="+name );}
+    buf.reset(new char[cap]);
+
+    if(opt.header){
+        if(next()){
+            for(std::string_view h:fields){header_v.emplace_back(h);}
+        }
+        line_count=0;
+    }
+}
+
+
+inline size_t Rows::column(std::string_view col_name)const{
+    auto x = std::find(header_v.begin(),header_v.end(),col_name);
+    if(x==header_v.end()){
+        throw std::runtime_error("Error in csv::Rows::column, no such column. col="+std::string(col_name)+", path="+name );
+    }
+    return static_cast<size_t>(x-header_v.begin());
+}
+
+
+inline bool Rows::refill(){
+    if(eof){return false;}
+
+    //keep the incomplete line at the begining, grow if it fills the buffer
+    const size_t kept = stop-pos;
+    if(kept==cap){
+        std::unique_ptr<char[]> b(new char[cap*2]);
+        std::memcpy(b.get(),buf.get()+pos,kept);
+        buf.swap(b);
+        cap*=2;
+    }else if(pos!=0){
+        std::memmove(buf.get(),buf.get()+pos,kept);
+    }
+    pos  = 0;
+    stop = kept;
+
+    in.read(buf.get()+stop,static_cast<std::streamsize>(cap-stop));
+    const size_t n = static_cast<size_t>(in.gcount());
+    stop+=n;
+    if(n==0){eof=true;}
+    return n!=0;
+}
+
+
+inline bool Rows::next(){
+    for(;;){
+        if(pos==stop && !refill()){return false;}
+
+        const char *b = buf.get()+pos;
+        const char *e = buf.get()+stop;
+        fields.clear();
+        const char *x = opt.quoted ? csv::simd::split_line_quoted(b,e,opt.sep,opt.endl,opt.quote,fields)
+                                   : csv::simd::split_line       (b,e,opt.sep,opt.endl,fields);
+        if(x==e && !eof){refill(); continue;} //incomplete line : split it again with more data, or at the end of the file
+
+        pos = (x==e ? stop : static_cast<size_t>(x-buf.get())+1);
+        if(opt.quoted){unquote();}
+        row.f      = &fields; //this object may have moved since the previous row
+        row.line_n = ++line_count;
+        return true;
+    }
+}
+
+
+//"a" => a, "a""b" => a"b
+inline void Rows::unquote(){
+    unescaped_used = 0;
+    for(auto &field:fields){
+        std::string_view f = field;
+        if(f.empty() || f.front()!=opt.quote){continue;}
+
+        f.remove_prefix(1);
+        if(!f.empty() && f.back()==opt.quote){f.remove_suffix(1);}
+
+        if(f.find(opt.quote)!=std::string_view::npos){
+            if(unescaped_used==unescaped.size()){unescaped.emplace_back();}
+            std::string &s = unescaped[unescaped_used++];
+            s.clear();
+            for(size_t j=0; j<f.size(); ++j){
+                s+=f[j];
+                if(f[j]==opt.quote && j+1<f.size() && f[j+1]==opt.quote){++j;}
+            }
+            f=s;
+        }
+        field=f;
+    }
+}
+
+
+}
+
+#endif
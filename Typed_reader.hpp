@@ -0,0 +1,307 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CSV_TYPED_READER_PIERRE_HPP
+#define CSV_TYPED_READER_PIERRE_HPP
+
+#include "tools/simd_scan.hpp"
+#include "tools/mmap_file.hpp"
+#include "tools/parse.hpp"
+#include "tools/str_cat.hpp"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace csv{
+
+//USAGE :
+//struct Row{std::string city; double habs; int year;};
+//
+//csv::Typed_reader<Row,
+//    csv::field<"city", &Row::city>,
+//    csv::field<"habs", &Row::habs>,
+//    csv::field<"year", &Row::year>
+//> r('\t');
+//
+//--- one row at a time ---
+//r.read("something.tsv", [&](size_t line, const Row &row){...});
+//
+//--- batches of rows ---
+//r.read_batches("something.tsv", 4096, [&](std::vector<Row> &rows){...});
+//
+//Members can be arithmetic, bool (0,1,true,false), dates, timestamps, std::optional of these,
+//or std::string : they are parsed with csv::parse::value, see tools/parse.hpp.
+//The header is read once to find the column of each field, then each line is split
+//and each field is parsed in place into the row : no std::function and no std::string per field.
+//Empty lines are skipped. Quoted fields are not supported, use Csv_reader::quoted.
+
+
+//a string usable as a template parameter : field<"name",...>
+template<size_t N>
+struct Fixed_string{
+    char value[N]{};
+    constexpr Fixed_string(const char (&s)[N]){for(size_t i=0;i<N;++i){value[i]=s[i];}}
+    constexpr std::string_view view()const{return std::string_view(value,N-1);}
+};
+
+
+template<Fixed_string Name, auto Member>
+struct field{
+    static constexpr std::string_view name  (){return Name.view();}
+    static constexpr auto             member(){return Member;}
+};
+
+
+namespace detail{
+
+template<typename T>
+bool parse_field(std::string_view s, T &x){
+    static_assert(!std::is_same_v<T,std::string_view>, "csv::field : member cannot be a std::string_view, the line buffer is reused");
+    return csv::parse::value(s,x);
+}
+
+}//end detail
+
+
+
+
+template<typename Row, typename... Fields>
+class Typed_reader{
+public:
+    static constexpr size_t field_count = sizeof...(Fields);
+
+    explicit Typed_reader(char sep_='\t' ,char  endl_='\n'):sep(sep_),endl(endl_){}
+
+    //Fn is callable as void(size_t line, const Row&)
+    template<typename Fn> size_t read(std::istream &in, const std::string &name, Fn &&fn);
+    template<typename Fn> size_t read(const std::filesystem::path &p, Fn &&fn);
+
+    //Fn is callable as void(std::vector<Row>&), called with at most batch_size rows
+    template<typename Fn> size_t read_batches(const std::filesystem::path &p, size_t batch_size, Fn &&fn);
+
+    std::function<void(std::string&)> at_header = [](std::string&){};
+      //called after reading a header => this is the place to simplify header names
+
+    char sep;
+    char endl;
+
+private:
+    std::string name; //used to produce clear error messages
+    size_t line_count=0;
+    std::array<size_t,field_count> col_index{}; //file column of each field
+    size_t min_fields=0;                        //a line needs at least min_fields fields
+    std::vector<std::string_view> fields;
+    std::string line_buf;
+
+    void read_header();
+
+    //parse fields into row, returns false if the line is empty
+    bool parse_row(Row &row);
+
+    template<size_t... I>
+    void parse_row(Row &row, std::index_sequence<I...>){ (parse_one<I,Fields>(row), ...); }
+
+    template<size_t I, typename F>
+    void parse_one(Row &row){
+        std::string_view s = fields[col_index[I]];
+        if(!detail::parse_field(s, row.*(F::member()) ))[[unlikely]]{
+            throw std::runtime_error("Error in Typed_reader::read : cannot parse token. line="+std::to_string(line_count)+", col="+std::string(F::name())+", token="+std::string(s)+", name="+name);
+        }
+    }
+
+    //reads the header, then parses each line in target() and calls fn(line, row)
+    template<typename Target, typename Fn> void read_buffer(std::string_view buffer, Target &&target, Fn &&fn);
+};
+
+
+
+
+template<typename Row, typename... Fields>
+void Typed_reader<Row,Fields...>::read_header(){
+    constexpr std::array<std::string_view,field_count> names{Fields::name()...};
+
+    std::set<std::string> seen_cols;
+    std::set<std::string> duplicated_cols;
+    std::array<bool,field_count> found{};
+
+    for(size_t c=0;c<fields.size();++c){
+        std::string h(fields[c]);
+        at_header(h);
+
+        if(!seen_cols.insert(h).second){duplicated_cols.insert(h);}
+        for(size_t i=0;i<field_count;++i){
+            if(names[i]==h){col_index[i]=c; found[i]=true;}
+        }
+    }
+
+    std::vector<std::string_view> missing_cols;
+    min_fields=0;
+    for(size_t i=0;i<field_count;++i){
+        if(!found[i]){missing_cols.push_back(names[i]);}
+        min_fields = std::max(min_fields,col_index[i]+1);
+    }
+
+    if(!missing_cols.empty()){
+        std::string err = "Error in Typed_reader::read_header "+ std::to_string(missing_cols.size()) +" columns are missing. missing =";
+        csv::str_cat(err, missing_cols, ", " );
+        err+=", found " + std::to_string(seen_cols.size()) +" columns = ";
+        csv::str_cat(err, seen_cols, ", " );
+        throw std::runtime_error( std::move(err) );
+    }
+
+    if(!duplicated_cols.empty()){
+        std::string err = "Error in Typed_reader::read_header duplicated columns names. duplicated =";
+        csv::str_cat(err, duplicated_cols, ", " );
+        throw std::runtime_error( std::move(err) );
+    }
+}
+
+
+template<typename Row, typename... Fields>
+bool Typed_reader<Row,Fields...>::parse_row(Row &row){
+    ++line_count;
+    if(fields.empty()){return false;}
+    if(fields.size()<min_fields)[[unlikely]]{
+        throw std::runtime_error("Error in Typed_reader::read : not enough items in line. line="+std::to_string(line_count)+", items="+std::to_string(fields.size())+", name="+name);
+    }
+    parse_row(row,std::index_sequence_for<Fields...>{});
+    return true;
+}
+
+
+template<typename Row, typename... Fields>
+template<typename Target, typename Fn>
+void Typed_reader<Row,Fields...>::read_buffer(std::string_view buffer, Target &&target, Fn &&fn){
+    const char *b = buffer.data();
+    const char *e = b+buffer.size();
+
+    auto next_line=[&](size_t max_fields){
+        fields.clear();
+        const char *x = csv::simd::split_line(b,e,sep,endl,fields,max_fields);
+        b = (x==e ? e : x+1);
+    };
+
+    line_count=0;
+    fields.clear();
+    if(b!=e){next_line(SIZE_MAX);}
+    read_header();
+
+    while(b!=e){
+        next_line(min_fields); //fields after the last needed column are skipped
+        Row &row = target();
+        if(parse_row(row)){fn(line_count,row);}
+    }
+}
+
+
+template<typename Row, typename... Fields>
+template<typename Fn>
+size_t Typed_reader<Row,Fields...>::read(std::istream &in, const std::string &name_, Fn &&fn){
+    name=name_;
+    line_count=0;
+
+    auto split=[&](size_t max_fields){
+        fields.clear();
+        csv::simd::split_line(line_buf.data(),line_buf.data()+line_buf.size(),sep,endl,fields,max_fields);
+    };
+
+    if(!std::getline(in,line_buf,endl)){line_buf.clear();}
+    split(SIZE_MAX);
+    read_header();
+
+    Row row{};
+    while(std::getline(in,line_buf,endl)){
+        split(min_fields);
+        if(parse_row(row)){fn(line_count,static_cast<const Row&>(row));}
+    }
+    return line_count;
+}
+
+
+template<typename Row, typename... Fields>
+template<typename Fn>
+size_t Typed_reader<Row,Fields...>::read(const std::filesystem::path &p, Fn &&fn){
+    if constexpr(CSV_HAS_MMAP){
+        name=p.generic_string();
+        csv::Mmap_file f(p);
+        f.advise_sequential();
+        Row row{};
+        read_buffer(f.view(),[&]()->Row&{return row;},[&](size_t line, Row &r){fn(line,static_cast<const Row&>(r));});
+        return line_count;
+    }else{
+        std::ifstream in( p );
+        if(!in){
+            throw std::runtime_error("Error in Typed_reader::read, cannot open file. path="+p.generic_string() );
+        }
+        return read(in,p.generic_string(),std::forward<Fn>(fn));
+    }
+}
+
+
+template<typename Row, typename... Fields>
+template<typename Fn>
+size_t Typed_reader<Row,Fields...>::read_batches(const std::filesystem::path &p, size_t batch_size, Fn &&fn){
+    if(batch_size==0){batch_size=1;}
+
+    //rows are parsed in place in the batch, the batch is reused
+    std::vector<Row> batch(batch_size);
+    size_t n=0;
+
+    auto on_row=[&](size_t, const Row &row){
+        if(&row!=&batch[n]){batch[n]=row;}
+        ++n;
+        if(n==batch_size){
+            fn(batch);
+            batch.resize(batch_size);
+            n=0;
+        }
+    };
+
+    if constexpr(CSV_HAS_MMAP){
+        name=p.generic_string();
+        csv::Mmap_file f(p);
+        f.advise_sequential();
+
+        read_buffer(f.view(),[&]()->Row&{return batch[n];},on_row);
+    }else{
+        read(p,on_row);
+    }
+
+    if(n!=0){
+        batch.resize(n);
+        fn(batch);
+    }
+    return line_count;
+}
+
+
+}
+
+#endif
@@ -0,0 +1,653 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+//USAGE :
+//csv_bench [--mb 32] [--dir /tmp/csv_bench] [--repeat 3] [--filter text] [--out results.json]
+//
+//Generates deterministic synthetic files (same seed => same bytes, on any platform),
+//then times each read and write API on each file.
+//  --mb     : approximate size of each generated file
+//  --dir    : where files are generated, kept between runs (regenerated if the size changed)
+//  --repeat : each case is run repeat times, the fastest run is reported
+//  --filter : only run the cases whose name contains text
+//  --out    : JSON results, default stdout
+//
+//Each case runs in a child process (fork) : peak_rss_kb is the peak of the case, plus the memory of the bench itself.
+//allocs_per_row counts the calls to operator new during the fastest run.
+
+#include "Csv_reader.hpp"
+#include "Csv_writer.hpp"
+#include "Rows.hpp"
+#include "tools/alloc_counter.hpp"
+#include "tools/fd_out.hpp"
+#include "tools/mmap_file.hpp"
+#include "tools/trim.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define CSV_BENCH_FORK 1
+    #include <sys/resource.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#else
+    #define CSV_BENCH_FORK 0
+#endif
+
+
+
+
+//=== allocation counter ===
+CSV_COUNT_ALLOCATIONS()
+
+
+
+
+namespace{
+
+volatile size_t g_sink = 0; //keeps the callbacks from being optimized away
+
+
+//=== deterministic generator ===
+//splitmix64 : std distributions differ between standard libraries, this doesn't
+struct Rng{
+    uint64_t s;
+    uint64_t next(){
+        uint64_t z = (s += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z>>30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z>>27)) * 0x94d049bb133111ebULL;
+        return z ^ (z>>31);
+    }
+    uint64_t below(uint64_t n){return next()%n;}
+};
+
+
+struct Dataset{
+    std::string name;
+    size_t cols;
+    bool   long_fields;
+    bool   numeric;
+    bool   quoted;  //quoted csv, text fields may contain sep and quotes
+
+    char sep()const{return quoted ? ',' : '\t';}
+};
+
+
+std::vector<Dataset> datasets(){
+    std::vector<Dataset> r;
+    for(size_t cols : {size_t(4),size_t(64)}){
+    for(bool lf : {false,true}){
+    for(bool num : {true,false}){
+    for(bool q : {false,true}){
+        std::string n = std::string(cols==4?"narrow":"wide")+"_"+(lf?"long":"short")+"_"+(num?"num":"text")+"_"+(q?"csv":"tsv");
+        r.push_back(Dataset{n,cols,lf,num,q});
+    }}}}
+    return r;
+}
+
+
+//one row of values, numeric columns alternate int64 and double
+struct Row_values{
+    std::vector<std::string> text;
+    std::vector<int64_t>     i64;
+    std::vector<double>      f64;
+};
+
+
+Row_values make_row(const Dataset &d, Rng &g){
+    Row_values r;
+    for(size_t c=0;c<d.cols;++c){
+        if(d.numeric){
+            if(c%2==0){r.i64.push_back(static_cast<int64_t>(g.below(d.long_fields ? 1000000000000000ULL : 10000)));}
+            else      {r.f64.push_back(static_cast<double>(g.below(d.long_fields ? 1000000000000ULL : 100000))/(d.long_fields?1e6:100.0));}
+            continue;
+        }
+        const size_t n = d.long_fields ? 30+g.below(20) : 3+g.below(4);
+        std::string s(n,'a');
+        for(auto &x:s){
+            x = static_cast<char>('a'+g.below(26));
+            if(d.quoted && g.below(40)==0){x = (g.below(2)==0 ? ',' : '"');}
+        }
+        r.text.push_back(std::move(s));
+    }
+    return r;
+}
+
+
+void append_text(std::string &o, const std::string &s, bool quoted, char sep){
+    if(!quoted || s.find_first_of(std::string{sep,'"','\n','\r'})==std::string::npos){o+=s; return;}
+    o+='"';
+    for(char c:s){o+=c; if(c=='"'){o+='"';}}
+    o+='"';
+}
+
+
+//writes about mb MB, returns the number of data rows
+size_t generate(const Dataset &d, const std::filesystem::path &p, size_t mb){
+    std::ofstream out(p,std::ios::binary);
+    if(!out){throw std::runtime_error("csv_bench : cannot write "+p.generic_string());}
+    Rng g{0x5eed0000+d.cols};
+
+    std::string o;
+    for(size_t c=0;c<d.cols;++c){
+        if(c!=0){o+=d.sep();}
+        o+="c"+std::to_string(c);
+    }
+    o+='\n';
+
+    const size_t target = mb<<20;
+    size_t bytes=0, rows=0;
+    char buf[64];
+    while(bytes<target){
+        Row_values r = make_row(d,g);
+        for(size_t c=0,ii=0,ff=0,tt=0;c<d.cols;++c){
+            if(c!=0){o+=d.sep();}
+            if(!d.numeric){append_text(o,r.text[tt++],d.quoted,d.sep()); continue;}
+            char *e = (c%2==0) ? std::to_chars(buf,buf+sizeof(buf),r.i64[ii++]).ptr : std::to_chars(buf,buf+sizeof(buf),r.f64[ff++]).ptr;
+            o.append(buf,e);
+        }
+        o+='\n';
+        ++rows;
+        if(o.size()>(1<<20)){bytes+=o.size(); out<<o; o.clear();}
+    }
+    bytes+=o.size();
+    out<<o;
+    return rows;
+}
+
+
+
+
+//=== measures ===
+struct Result{
+    std::string name;
+    std::string dataset;
+    std::string api;
+    double      seconds  = 0;
+    size_t      bytes    = 0;
+    size_t      rows     = 0;
+    size_t      allocs   = 0;
+    long        peak_rss_kb = -1;
+};
+
+
+long peak_rss_kb(){
+    #if CSV_BENCH_FORK
+    rusage u{};
+    getrusage(RUSAGE_SELF,&u);
+    #if defined(__APPLE__)
+    return u.ru_maxrss/1024;
+    #else
+    return u.ru_maxrss;
+    #endif
+    #else
+    return -1;
+    #endif
+}
+
+
+//fn returns the number of rows, the fastest of repeat runs is kept
+Result measure(size_t repeat, const std::function<size_t()> &fn){
+    Result best;
+    best.seconds = 1e300;
+    for(size_t i=0;i<repeat;++i){
+        const size_t a0 = csv::allocation_count().load();
+        auto t0 = std::chrono::steady_clock::now();
+        size_t rows = fn();
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+        const size_t a = csv::allocation_count().load()-a0;
+        if(s<best.seconds){best.seconds=s; best.rows=rows; best.allocs=a;}
+    }
+    best.peak_rss_kb = peak_rss_kb();
+    return best;
+}
+
+
+
+
+//=== cases ===
+struct Case{
+    std::string dataset;
+    std::string api;
+    std::function<Result()> run;
+    std::string name()const{return dataset+"/"+api;}
+};
+
+
+//registered columns for a projection ratio : all, 1/4, one column
+std::vector<size_t> projected(size_t cols, const std::string &proj){
+    std::vector<size_t> r;
+    const size_t step = proj=="all" ? 1 : proj=="quarter" ? 4 : cols;
+    for(size_t c=0;c<cols;c+=step){r.push_back(c);}
+    return r;
+}
+
+
+void add_read_cases(std::vector<Case> &v, const Dataset &d, const std::filesystem::path &p, size_t repeat){
+    auto reader=[d](csv::Csv_reader &r){
+        r.sep    = d.sep();
+        r.quoted = d.quoted;
+    };
+
+    for(std::string proj : {"all","quarter","one"}){
+        const std::vector<size_t> cols = projected(d.cols,proj);
+
+        auto add=[&](const std::string &api, std::function<size_t()> fn){
+            v.push_back(Case{d.name,"read_"+api+"_"+proj,[=](){
+                Result r = measure(repeat,fn);
+                r.bytes = std::filesystem::file_size(p);
+                return r;
+            }});
+        };
+
+        //callback, std::string&&, std::ifstream
+        add("callback",[=](){
+            csv::Csv_reader r; reader(r);
+            size_t sum=0;
+            for(size_t c:cols){r.add_column("c"+std::to_string(c),[&](size_t, std::string &&s){sum+=s.size();});}
+            size_t n = r.read(p);
+            g_sink=sum;
+            return n;
+        });
+
+        //zero copy callbacks, for each input
+        for(auto in : {csv::Csv_reader::Input::stream,csv::Csv_reader::Input::mmap,csv::Csv_reader::Input::read_ahead}){
+            const char *in_name = in==csv::Csv_reader::Input::stream ? "stream" : in==csv::Csv_reader::Input::mmap ? "mmap" : "read_ahead";
+            add(std::string("view_")+in_name,[=](){
+                csv::Csv_reader r; reader(r);
+                r.input = in;
+                size_t sum=0;
+                for(size_t c:cols){r.add_column("c"+std::to_string(c),[&](size_t, std::string_view s){sum+=s.size();});}
+                size_t n = r.read(p);
+                g_sink=sum;
+                return n;
+            });
+        }
+
+        //Row_view
+        add("row_view_mmap",[=](){
+            csv::Csv_reader r; reader(r);
+            r.input = csv::Csv_reader::Input::mmap;
+            size_t sum=0;
+            std::vector<size_t> idx;
+            for(size_t c:cols){idx.push_back(r.add_column("c"+std::to_string(c)));}
+            r.at_row=[&](const csv::Row_view &row){for(size_t i:idx){sum+=row[i].size();}};
+            size_t n = r.read(p);
+            g_sink=sum;
+            return n;
+        });
+
+        //pull : csv::rows
+        add("rows_pull",[=](){
+            csv::Rows::Options o;
+            o.sep    = d.sep();
+            o.quoted = d.quoted;
+            size_t sum=0, n=0;
+            for(const auto &row : csv::rows(p,o)){
+                for(size_t c:cols){sum+=row[c].size();}
+                ++n;
+            }
+            g_sink=sum;
+            return n;
+        });
+
+        //a filter on the first column that rejects every line : cost of a skipped line
+        add("filter_mmap",[=](){
+            csv::Csv_reader r; reader(r);
+            r.input = csv::Csv_reader::Input::mmap;
+            size_t sum=0;
+            for(size_t c:cols){r.add_column("c"+std::to_string(c),[&](size_t, std::string_view s){sum+=s.size();});}
+            r.add_filter("c0",csv::filter::equal("none"));
+            size_t n = r.read(p);
+            g_sink=sum+r.filtered();
+            return n;
+        });
+
+        //trim all tokens : at_token on a std::string, or the trim_fields policy on the views
+        add("trim_at_token",[=](){
+            csv::Csv_reader r; reader(r);
+            r.input = csv::Csv_reader::Input::mmap;
+            r.at_token = [](std::string &s){csv::trim(s);};
+            size_t sum=0;
+            for(size_t c:cols){r.add_column("c"+std::to_string(c),[&](size_t, std::string &&s){sum+=s.size();});}
+            size_t n = r.read(p);
+            g_sink=sum;
+            return n;
+        });
+        add("trim_policy",[=](){
+            csv::Csv_reader r; reader(r);
+            r.input = csv::Csv_reader::Input::mmap;
+            r.trim_fields = true;
+            size_t sum=0;
+            for(size_t c:cols){r.add_column("c"+std::to_string(c),[&](size_t, std::string_view s){sum+=s.size();});}
+            size_t n = r.read(p);
+            g_sink=sum;
+            return n;
+        });
+
+        //gzip copy of the file, decompressed by a Read_ahead thread. bytes : uncompressed, as the other cases
+        if(proj=="all" && CSV_HAS_ZLIB){
+            const std::filesystem::path pz = p.string()+".gz";
+            if(!std::filesystem::exists(pz) || std::filesystem::last_write_time(pz)<std::filesystem::last_write_time(p)){
+                csv::Mmap_file f(p);
+                csv::Fd_out o(pz);
+                o.append(f.view());
+                o.close();
+            }
+            add("view_gzip",[=](){
+                csv::Csv_reader r; reader(r);
+                size_t sum=0;
+                for(size_t c:cols){r.add_column("c"+std::to_string(c),[&](size_t, std::string_view s){sum+=s.size();});}
+                size_t n = r.read(pz);
+                g_sink=sum;
+                return n;
+            });
+        }
+
+        //numbers : std::stoll / std::stod on a std::string, or add_column<T> (csv::parse)
+        if(d.numeric){
+            add("numbers_sto",[=](){
+                csv::Csv_reader r; reader(r);
+                r.input = csv::Csv_reader::Input::mmap;
+                double sum=0;
+                for(size_t c:cols){
+                    if(c%2==0){r.add_column("c"+std::to_string(c),[&](size_t, std::string &&s){sum+=static_cast<double>(std::stoll(s));});}
+                    else      {r.add_column("c"+std::to_string(c),[&](size_t, std::string &&s){sum+=std::stod(s);});}
+                }
+                size_t n = r.read(p);
+                g_sink=static_cast<size_t>(sum);
+                return n;
+            });
+            add("numbers_parse",[=](){
+                csv::Csv_reader r; reader(r);
+                r.input = csv::Csv_reader::Input::mmap;
+                double sum=0;
+                for(size_t c:cols){
+                    if(c%2==0){r.add_column<int64_t>("c"+std::to_string(c),[&](size_t, int64_t x){sum+=static_cast<double>(x);});}
+                    else      {r.add_column<double> ("c"+std::to_string(c),[&](size_t, double  x){sum+=x;});}
+                }
+                size_t n = r.read(p);
+                g_sink=static_cast<size_t>(sum);
+                return n;
+            });
+        }
+
+        //parallel, ordered
+        add("parallel_ordered",[=](){
+            csv::Csv_reader r; reader(r);
+            size_t sum=0;
+            for(size_t c:cols){r.add_column("c"+std::to_string(c),[&](size_t, std::string_view s){sum+=s.size();});}
+            size_t n = r.read_parallel(p,csv::Csv_reader::Parallel());
+            g_sink=sum;
+            return n;
+        });
+    }
+}
+
+
+void add_write_cases(std::vector<Case> &v, const Dataset &d, size_t rows, const std::filesystem::path &dir, size_t repeat){
+    //a pool of rows, written in a loop
+    Rng g{0xbe11c4+d.cols};
+    std::vector<Row_values> pool;
+    for(size_t i=0;i<1024;++i){pool.push_back(make_row(d,g));}
+
+    const std::filesystem::path p = dir/(d.name+".out");
+    const csv::Csv_writer::Escape escape = d.quoted ? csv::Csv_writer::Escape::if_needed : csv::Csv_writer::Escape::none;
+
+    auto writer=[=](csv::Csv_writer &w, csv::Csv_writer::Output o){
+        w.sep    = d.sep();
+        w.escape = escape;
+        for(size_t c=0;c<d.cols;++c){w.add_column("c"+std::to_string(c));}
+        w.set_write(p,o);
+        w.write_header();
+    };
+
+    //calls fn(index, value) for each value of a row
+    auto for_each=[d](const Row_values &r, auto &&fn){
+        for(size_t c=0,ii=0,ff=0,tt=0;c<d.cols;++c){
+            if(!d.numeric ){fn(c,r.text[tt++]);}
+            else if(c%2==0){fn(c,r.i64[ii++]);}
+            else           {fn(c,r.f64[ff++]);}
+        }
+    };
+
+    auto add=[&](const std::string &api, std::function<void(csv::Csv_writer&, const Row_values&)> line, csv::Csv_writer::Output o){
+        v.push_back(Case{d.name,"write_"+api,[=](){
+            Result r = measure(repeat,[&](){
+                csv::Csv_writer w;
+                writer(w,o);
+                for(size_t i=0;i<rows;++i){line(w,pool[i%pool.size()]);}
+                w.close();
+                return rows;
+            });
+            r.bytes = std::filesystem::file_size(p);
+            std::filesystem::remove(p);
+            return r;
+        }});
+    };
+
+    std::vector<std::string> names;
+    for(size_t c=0;c<d.cols;++c){names.push_back("c"+std::to_string(c));}
+
+    for(auto o : {csv::Csv_writer::Output::ostream,csv::Csv_writer::Output::native}){
+        const std::string on = (o==csv::Csv_writer::Output::native ? "_native" : "_ostream");
+
+        add("token_by_name"+on,[=](csv::Csv_writer &w, const Row_values &r){
+            for_each(r,[&](size_t c, const auto &x){w.write_token(names[c],x);});
+            w.write_endl();
+        },o);
+
+        add("token_by_index"+on,[=](csv::Csv_writer &w, const Row_values &r){
+            for_each(r,[&](size_t c, const auto &x){w.write_token(c,x);});
+            w.write_endl();
+        },o);
+
+        add("write_tokens"+on,[=](csv::Csv_writer &w, const Row_values &r){
+            for_each(r,[&](size_t, const auto &x){w.write_tokens(x);});
+            w.write_endl();
+        },o);
+
+        //write_line needs the arity at compile time : 4 columns, or 64 columns as 16 groups of 4
+        add("write_line"+on,[=](csv::Csv_writer &w, const Row_values &r){
+            auto v4=[&](auto &&f){
+                for(size_t c=0,ii=0,ff=0;c<d.cols;c+=4,ii+=2,ff+=2){
+                    if(d.numeric){f(r.i64[ii],r.f64[ff],r.i64[ii+1],r.f64[ff+1]);}
+                    else         {f(r.text[c],r.text[c+1],r.text[c+2],r.text[c+3]);}
+                }
+            };
+            if(d.cols==4){v4([&](const auto&... x){w.write_line(x...);}); return;}
+            size_t c=0;
+            v4([&](const auto&... x){w.write_tokens_at(c,x...); c+=4;});
+            w.write_endl();
+        },o);
+    }
+}
+
+
+
+
+//=== json ===
+std::string json_escape(const std::string &s){
+    std::string r;
+    for(char c:s){
+        if(c=='"' || c=='\\'){r+='\\';}
+        r+=c;
+    }
+    return r;
+}
+
+
+void print_json(std::ostream &o, const std::vector<Result> &v, size_t mb, size_t repeat){
+    o<<"{\n  \"mb\": "<<mb<<",\n  \"repeat\": "<<repeat<<",\n  \"results\": [\n";
+    for(size_t i=0;i<v.size();++i){
+        const Result &r = v[i];
+        const double s = std::max(r.seconds,1e-9);
+        o<<"    {\"name\": \""<<json_escape(r.name)<<"\", \"dataset\": \""<<json_escape(r.dataset)<<"\", \"api\": \""<<json_escape(r.api)<<"\""
+         <<", \"seconds\": "<<r.seconds
+         <<", \"bytes\": "<<r.bytes
+         <<", \"rows\": "<<r.rows
+         <<", \"mb_per_s\": "<<(static_cast<double>(r.bytes)/(1<<20)/s)
+         <<", \"rows_per_s\": "<<(static_cast<double>(r.rows)/s)
+         <<", \"allocs_per_row\": "<<(r.rows==0 ? 0.0 : static_cast<double>(r.allocs)/static_cast<double>(r.rows))
+         <<", \"peak_rss_kb\": "<<r.peak_rss_kb
+         <<"}"<<(i+1==v.size() ? "" : ",")<<"\n";
+    }
+    o<<"  ]\n}\n";
+}
+
+
+//runs c in a child process, the result comes back through a pipe
+Result run_case(const Case &c){
+    #if CSV_BENCH_FORK
+    int fd[2];
+    if(pipe(fd)!=0){throw std::runtime_error("csv_bench : pipe failed");}
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if(pid<0){throw std::runtime_error("csv_bench : fork failed");}
+    if(pid==0){
+        ::close(fd[0]);
+        int status=0;
+        try{
+            Result r = c.run();
+            std::ostringstream s;
+            s.precision(17);
+            s<<r.seconds<<' '<<r.bytes<<' '<<r.rows<<' '<<r.allocs<<' '<<r.peak_rss_kb;
+            const std::string x = s.str();
+            if(::write(fd[1],x.data(),x.size())!=static_cast<ssize_t>(x.size())){status=1;}
+        }catch(std::exception &e){
+            std::cerr<<"csv_bench : "<<c.name()<<" failed : "<<e.what()<<"\n";
+            status=1;
+        }
+        ::close(fd[1]);
+        _exit(status);
+    }
+
+    ::close(fd[1]);
+    std::string x;
+    char buf[256];
+    for(ssize_t n; (n=::read(fd[0],buf,sizeof(buf)))>0;){x.append(buf,static_cast<size_t>(n));}
+    ::close(fd[0]);
+    int status=0;
+    waitpid(pid,&status,0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status)!=0){throw std::runtime_error("csv_bench : case failed, "+c.name());}
+
+    Result r;
+    std::istringstream s(x);
+    s>>r.seconds>>r.bytes>>r.rows>>r.allocs>>r.peak_rss_kb;
+    #else
+    Result r = c.run();
+    #endif
+    r.name    = c.name();
+    r.dataset = c.dataset;
+    r.api     = c.api;
+    return r;
+}
+
+}//end namespace
+
+
+
+
+int main(int argc, char **argv){
+    size_t mb     = 32;
+    size_t repeat = 3;
+    std::filesystem::path dir = std::filesystem::temp_directory_path()/"csv_bench";
+    std::string filter;
+    std::string out_path;
+
+    try{
+        for(int i=1;i<argc;++i){
+            const std::string a = argv[i];
+            auto value=[&]()->std::string{
+                if(i+1>=argc){throw std::runtime_error("csv_bench : missing value after "+a);}
+                return argv[++i];
+            };
+            if     (a=="--mb"    ){mb     = std::stoul(value());}
+            else if(a=="--repeat"){repeat = std::max<size_t>(std::stoul(value()),1);}
+            else if(a=="--dir"   ){dir    = value();}
+            else if(a=="--filter"){filter = value();}
+            else if(a=="--out"   ){out_path = value();}
+            else{throw std::runtime_error("csv_bench : unknown option "+a+", see the usage in bench/csv_bench.cpp");}
+        }
+
+        std::filesystem::create_directories(dir);
+
+        std::vector<Case> cases;
+        for(const Dataset &d : datasets()){
+            const std::filesystem::path p = dir/(d.name+"_"+std::to_string(mb)+"mb."+(d.quoted?"csv":"tsv"));
+            std::vector<Case> v;
+            add_read_cases (v,d,p,repeat);
+            add_write_cases(v,d,0,dir,repeat);
+
+            bool any=false;
+            for(const Case &c:v){any = any || c.name().find(filter)!=std::string::npos;}
+            if(!any){continue;}
+
+            //generate once, rows are needed by the write cases
+            if(!std::filesystem::exists(p)){std::cerr<<"generating "<<p.generic_string()<<"\n"; generate(d,p,mb);}
+            size_t rows=0;
+            {
+                std::ifstream in(p,std::ios::binary);
+                std::string l;
+                while(std::getline(in,l)){++rows;}
+                rows = rows==0 ? 0 : rows-1;
+            }
+
+            v.clear();
+            add_read_cases (v,d,p,repeat);
+            add_write_cases(v,d,rows,dir,repeat);
+            for(Case &c:v){
+                if(c.name().find(filter)!=std::string::npos){cases.push_back(std::move(c));}
+            }
+        }
+
+        std::vector<Result> results;
+        for(const Case &c:cases){
+            std::cerr<<c.name()<<"\n";
+            results.push_back(run_case(c));
+        }
+
+        if(out_path.empty()){
+            print_json(std::cout,results,mb,repeat);
+        }else{
+            std::ofstream o(out_path);
+            print_json(o,results,mb,repeat);
+            if(!o){throw std::runtime_error("csv_bench : cannot write "+out_path);}
+        }
+    }catch(std::exception &e){
+        std::cerr<<e.what()<<"\n";
+        return 1;
+    }
+    return 0;
+}
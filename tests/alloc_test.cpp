@@ -0,0 +1,169 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+//Steady state allocations, counted with tools/alloc_counter.hpp :
+//  Csv_reader::at_row makes no allocation per line, with each Input (stream, mmap, read_ahead).
+//  Csv_writer writes numeric rows without allocation, with each Output, as std::ostream would write them.
+//Returns 1 and prints the failed checks.
+
+#include "Csv_reader.hpp"
+#include "Csv_writer.hpp"
+#include "tools/alloc_counter.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+
+CSV_COUNT_ALLOCATIONS()
+
+
+namespace{
+
+size_t failures = 0;
+
+void check(bool ok, const std::string &what){
+    if(!ok){++failures; std::cerr<<"FAILED : "<<what<<"\n";}
+}
+
+size_t allocations(){return csv::allocation_count().load(std::memory_order_relaxed);}
+
+void write_file(const std::filesystem::path &p, size_t rows){
+    std::ofstream out(p, std::ios::binary);
+    out<<"city\tpopulation\tcountry\tyear\n";
+    for(size_t i=0;i<rows;++i){
+        out<<"city_"<<(i%1000)<<"\t"<<(100000+i%7919)<<"\tcountry_"<<(i%50)<<"\t"<<(1900+i%100)<<"\n";
+    }
+}
+
+const char *input_name(csv::Csv_reader::Input i){
+    switch(i){
+        case csv::Csv_reader::Input::stream     : return "stream";
+        case csv::Csv_reader::Input::mmap       : return "mmap";
+        case csv::Csv_reader::Input::read_ahead : return "read_ahead";
+    }
+    return "?";
+}
+
+
+//allocations of at_row lines, after warm_up lines
+void test_at_row(const std::filesystem::path &dir){
+    constexpr size_t warm_up = 1000; //the longest line of write_file is before : the line buffers have their final size
+    const std::filesystem::path small = dir/"small.tsv";
+    const std::filesystem::path large = dir/"large.tsv";
+    write_file(small,  2000);
+    write_file(large, 200000);
+
+    for(auto input : {csv::Csv_reader::Input::stream, csv::Csv_reader::Input::mmap, csv::Csv_reader::Input::read_ahead}){
+        size_t rows  [2] = {0,0}; //small, large : from the warm-up line to the last line
+        size_t steady[2] = {0,0}; //                from the warm-up line to the end of read
+        size_t total [2] = {0,0};
+        for(size_t k=0;k<2;++k){
+            csv::Csv_reader r('\t');
+            r.input = input;
+            r.read_ahead.buffer_size = 1<<16; //several buffers per file
+            const size_t i_city = r.add_column("city");
+            const size_t i_year = r.add_column("year");
+            size_t n=0, bytes=0, a0=0, a1=0;
+            r.at_row=[&](const csv::Row_view &row){
+                bytes+=row[i_city].size()+row[i_year].size();
+                if(++n==warm_up){a0=allocations();}
+                a1=allocations();
+            };
+
+            const size_t t0 = allocations();
+            const size_t lines = r.read(k==0 ? small : large);
+            const size_t t1 = allocations();
+            rows  [k] = a1-a0;
+            steady[k] = t1-a0;
+            total [k] = t1-t0;
+            check(lines==n && bytes!=0, std::string(input_name(input))+" : at_row is called on each line");
+        }
+        std::cout<<input_name(input)<<" : allocations between lines small="<<rows[0]<<" large="<<rows[1]
+                 <<", after warm-up small="<<steady[0]<<" large="<<steady[1]
+                 <<", per read small="<<total[0]<<" large="<<total[1]<<"\n";
+        check(rows[0]==0 && rows[1]==0, std::string(input_name(input))+" : at_row allocates between lines");
+        check(steady[0]==steady[1], std::string(input_name(input))+" : at_row allocations grow with the line count");
+        check(total [0]==total [1], std::string(input_name(input))+" : read allocations grow with the line count");
+    }
+}
+
+
+
+//allocations of numeric rows, after warm_up rows. The text is the text of std::ostream
+void test_numeric_rows(const std::filesystem::path &dir){
+    constexpr size_t warm_up = 100;
+    constexpr size_t rows    = 100000;
+    const std::filesystem::path p = dir/"numbers.tsv";
+
+    for(auto output : {csv::Csv_writer::Output::ostream, csv::Csv_writer::Output::native}){
+        const std::string name = output==csv::Csv_writer::Output::ostream ? "ostream" : "native";
+        size_t a0=0, a1=0;
+        {
+            csv::Csv_writer w;
+            w.add_column("id");
+            w.add_column("x");
+            w.add_column("y");
+            w.add_column("ok");
+            w.set_write(p,output);
+            w.write_header();
+            for(size_t i=0;i<rows;++i){
+                if(i==warm_up){a0=allocations();}
+                const double x = 3.14159265358979*static_cast<double>(i);
+                if(i%2==0){w.write_line(static_cast<int64_t>(i),x,1e-7*static_cast<double>(i),i%3==0);}
+                else{w.write_tokens(static_cast<int64_t>(i),x,1e-7*static_cast<double>(i),i%3==0); w.write_endl();}
+            }
+            a1=allocations();
+            w.close();
+        }
+        std::cout<<name<<" : allocations of "<<rows-warm_up<<" numeric rows="<<a1-a0<<"\n";
+        check(a1==a0, name+" : numeric rows allocate");
+
+        std::ifstream in(p, std::ios::binary);
+        std::string line;
+        std::getline(in,line); //header
+        size_t bad=0;
+        for(size_t i=0;i<rows && std::getline(in,line);++i){
+            std::ostringstream s;
+            s<<i<<"\t"<<3.14159265358979*static_cast<double>(i)<<"\t"<<1e-7*static_cast<double>(i)<<"\t"<<(i%3==0);
+            if(line!=s.str()){
+                if(bad++==0){std::cerr<<name<<" : line "<<i+1<<"="<<line<<", std::ostream="<<s.str()<<"\n";}
+            }
+        }
+        check(bad==0, name+" : floating points differ from std::ostream");
+    }
+}
+
+}
+
+
+int main(){
+    const std::filesystem::path dir = std::filesystem::temp_directory_path()/"csv_alloc_test";
+    std::filesystem::create_directories(dir);
+
+    test_at_row(dir);
+    test_numeric_rows(dir);
+
+    std::filesystem::remove_all(dir);
+    std::cout<<failures<<" failures\n";
+    return failures==0 ? 0 : 1;
+}
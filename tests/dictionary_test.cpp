@@ -0,0 +1,105 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+//tools/dictionary.hpp : ids in order of first appearance, stable views, the empty value
+//(first value, after clear, among large values), npos when full, and Csv_reader::add_column_interned.
+//Returns 1 and prints the failed checks.
+
+#include "Csv_reader.hpp"
+#include "tools/dictionary.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace{
+
+size_t failures = 0;
+
+void check(bool ok, const std::string &what){
+    if(!ok){++failures; std::cerr<<"FAILED : "<<what<<"\n";}
+}
+
+
+void test_empty_value(){
+    csv::Dictionary d;
+    check(d.intern("")==0,   "\"\" first : id 0");
+    check(d.intern("FR")==1, "FR after \"\" : id 1");
+    check(d.intern("")==0,   "\"\" again : same id");
+    check(d[0].empty() && d[1]=="FR", "values of \"\" and FR");
+    check(d.find("")==0, "find \"\"");
+
+    d.clear();
+    check(d.size()==0 && d.find("")==csv::Dictionary::npos, "clear removes \"\"");
+    check(d.intern("")==0,   "\"\" first after clear : id 0");
+    check(d.intern("DE")==1, "DE after clear : id 1");
+
+    //a large value has its own block, before any small block
+    csv::Dictionary l;
+    const std::string big(100000,'x');
+    check(l.intern(big)==0 && l.intern("")==1 && l.intern("a")==2, "large value, then \"\" and a small value");
+    check(l[0]==big && l[1].empty() && l[2]=="a", "values of large, \"\" and a small value");
+}
+
+
+void test_ids_and_views(){
+    csv::Dictionary d(1000);
+    std::vector<std::string_view> views;
+    for(size_t i=0;i<1000;++i){
+        const uint32_t id = d.intern("value_"+std::to_string(i));
+        check(id==i, "ids in order of first appearance, i="+std::to_string(i));
+        views.push_back(d[id]);
+    }
+    for(size_t i=0;i<1000;++i){
+        if(views[i]!="value_"+std::to_string(i) || d.find(views[i])!=i){check(false,"views are stable, i="+std::to_string(i)); break;}
+    }
+    check(d.full(), "full at max_size");
+    check(d.intern("value_1")==1, "a known value when full");
+    check(d.intern("new")==csv::Dictionary::npos && d.overflow()==1, "a new value when full : npos");
+}
+
+
+//the empty cell is the first value of the column
+void test_interned_column(){
+    std::istringstream in("country\tx\n\t1\nFR\t2\n\t3\n");
+    csv::Csv_reader r('\t');
+    std::vector<uint32_t>    ids;
+    std::vector<std::string> values;
+    r.add_column_interned("country",[&](size_t, uint32_t id, std::string_view v){ids.push_back(id); values.emplace_back(v);});
+    r.at_line=[](size_t){};
+    const size_t n = r.read(in,"test");
+    check(n==3, "interned column : 3 lines");
+    check(ids==std::vector<uint32_t>({0,1,0}), "interned column : ids");
+    check(values==std::vector<std::string>({"","FR",""}), "interned column : values");
+}
+
+}
+
+
+int main(){
+    test_empty_value();
+    test_ids_and_views();
+    test_interned_column();
+
+    std::cout<<failures<<" failures\n";
+    return failures==0 ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+//tools/filter.hpp : equal, prefix, range, and in with a few values (linear scan) or more than 8 (Dictionary),
+//the empty string included ("missing or one of these"). Then Csv_reader::add_filter.
+//Returns 1 and prints the failed checks.
+
+#include "Csv_reader.hpp"
+#include "tools/filter.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace{
+
+size_t failures = 0;
+
+void check(bool ok, const std::string &what){
+    if(!ok){++failures; std::cerr<<"FAILED : "<<what<<"\n";}
+}
+
+
+void test_predicates(){
+    const auto eq = csv::filter::equal("OK");
+    check(eq("OK") && !eq("OK ") && !eq(""), "equal");
+
+    const auto pre = csv::filter::prefix("FR-");
+    check(pre("FR-31") && pre("FR-") && !pre("FR") && !pre(""), "prefix");
+
+    const auto rg = csv::filter::range(10,100);
+    check(rg("10") && rg("55.5") && rg("100") && !rg("9.99") && !rg("abc") && !rg(""), "range");
+}
+
+
+void test_in(){
+    //linear scan
+    const auto few = csv::filter::in({"","EU","US"});
+    check(few("") && few("EU") && few("US") && !few("FR") && !few(" "), "in, 3 values with \"\"");
+
+    //Dictionary : more than 8 values, "" first, in the middle, or absent
+    const std::vector<std::vector<std::string>> sets = {
+        {"","a","b","c","d","e","f","g","h"},
+        {"a","b","c","d","","e","f","g","h","i","j"},
+        {"a","b","c","d","e","f","g","h","i"},
+    };
+    for(size_t k=0;k<sets.size();++k){
+        const auto f = csv::filter::in(sets[k]);
+        bool has_empty = false;
+        for(const auto &x:sets[k]){
+            has_empty |= x.empty();
+            check(f(x), "in, set "+std::to_string(k)+" : "+x+" is in");
+        }
+        check(f("")==has_empty, "in, set "+std::to_string(k)+" : \"\"");
+        check(!f("z") && !f("aa"), "in, set "+std::to_string(k)+" : values not in");
+    }
+}
+
+
+void test_add_filter(){
+    std::istringstream in("region\tx\nEU\t1\n\t2\nFR\t3\nUS\t4\nzz\t5\n");
+    csv::Csv_reader r('\t');
+    r.add_filter("region", csv::filter::in({"","EU","US","a","b","c","d","e","f"}));
+    std::vector<std::string> x;
+    r.add_column("x",[&](size_t, std::string_view s){x.emplace_back(s);});
+    r.at_line=[](size_t){};
+    const size_t n = r.read(in,"test");
+    check(n==5 && r.filtered()==2, "add_filter : 5 lines, 2 filtered");
+    check(x==std::vector<std::string>({"1","2","4"}), "add_filter : kept lines");
+}
+
+}
+
+
+int main(){
+    test_predicates();
+    test_in();
+    test_add_filter();
+
+    std::cout<<failures<<" failures\n";
+    return failures==0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+//Parallel_writer : Order::any keeps the lines of each producer, Order::sequence writes blocks in order,
+//close throws on a duplicate, an already written or a missing sequence number,
+//and numbers have the text of Csv_writer.
+//Returns 1 and prints the failed checks.
+
+#include "Csv_writer.hpp"
+#include "Parallel_writer.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace{
+
+size_t failures = 0;
+
+void check(bool ok, const std::string &what){
+    if(!ok){++failures; std::cerr<<"FAILED : "<<what<<"\n";}
+}
+
+std::vector<std::string> lines_of(const std::filesystem::path &p){
+    std::ifstream in(p, std::ios::binary);
+    std::vector<std::string> r;
+    for(std::string l; std::getline(in,l);){r.push_back(l);}
+    return r;
+}
+
+//close, returns the message of the exception or ""
+std::string close_error(csv::Parallel_writer &w){
+    try{w.close();}catch(std::exception &e){return e.what();}
+    return "";
+}
+
+
+void test_any(const std::filesystem::path &p){
+    constexpr size_t threads = 4;
+    constexpr size_t rows    = 20000;
+    csv::Parallel_writer w;
+    w.add_column("thread");
+    w.add_column("row");
+    csv::Parallel_writer::Options opt;
+    opt.buffer_size = 4096; //many blocks
+    w.set_write(p,opt);
+    w.write_header();
+
+    std::vector<std::thread> t;
+    for(size_t k=0;k<threads;++k){
+        t.emplace_back([&,k](){
+            csv::Parallel_writer::Producer pr = w.producer();
+            for(size_t i=0;i<rows;++i){pr.write_line(static_cast<int64_t>(k),static_cast<int64_t>(i));}
+        });
+    }
+    for(auto &x:t){x.join();}
+    check(close_error(w).empty(), "any : close");
+
+    const auto l = lines_of(p);
+    check(l.size()==threads*rows+1 && l[0]=="thread\trow", "any : header and line count");
+    std::vector<size_t> next(threads,0);
+    bool ordered = true;
+    for(size_t i=1;i<l.size();++i){
+        const size_t tab = l[i].find('\t');
+        const size_t k   = std::stoul(l[i].substr(0,tab));
+        ordered &= k<threads && std::stoul(l[i].substr(tab+1))==next[k]++;
+    }
+    check(ordered, "any : lines of each producer in order");
+}
+
+
+//rows of seq are {seq*10, seq*10+1}, submitted in the order of v
+std::string write_sequence(const std::filesystem::path &p, const std::vector<size_t> &v){
+    csv::Parallel_writer w;
+    w.add_column("row");
+    csv::Parallel_writer::Options opt;
+    opt.order = csv::Parallel_writer::Order::sequence;
+    w.set_write(p,opt);
+    w.write_header();
+    {
+        csv::Parallel_writer::Producer pr = w.producer();
+        for(size_t seq:v){
+            pr.write_line(static_cast<int64_t>(seq*10));
+            pr.write_line(static_cast<int64_t>(seq*10+1));
+            pr.submit(seq);
+        }
+    }
+    return close_error(w);
+}
+
+
+void test_sequence(const std::filesystem::path &p){
+    check(write_sequence(p,{2,0,3,1}).empty(), "sequence : close");
+    check(lines_of(p)==std::vector<std::string>({"row","0","1","10","11","20","21","30","31"}), "sequence : blocks in order");
+
+    //duplicate while pending, duplicate of a written block, gap
+    const std::string pending = write_sequence(p,{1,1,0});
+    check(pending.find("duplicate sequence number, seq=1")!=std::string::npos, "sequence : duplicate pending block throws, got="+pending);
+
+    const std::string written = write_sequence(p,{0,1,0});
+    check(written.find("duplicate sequence number, seq=0")!=std::string::npos, "sequence : block already written throws, got="+written);
+
+    const std::string missing = write_sequence(p,{0,2});
+    check(missing.find("missing block, seq=1")!=std::string::npos, "sequence : missing block throws, got="+missing);
+}
+
+
+
+//same columns, same precision => same file as Csv_writer
+void test_same_text(const std::filesystem::path &dir){
+    const double x[] = {3.14159265358979, 1e-7, 123456789.0, 0.1+0.2, -2.5, 1e300};
+    for(std::optional<int> precision : {std::optional<int>(), std::optional<int>(csv::precision_general), std::optional<int>(csv::precision_round_trip), std::optional<int>(3)}){
+        const std::string name = precision ? "precision="+std::to_string(*precision) : "default precision";
+
+        csv::Csv_writer c;
+        c.add_column("x");
+        c.add_column("y");
+        if(precision){c.set_precision(1,*precision);}
+        c.set_write(dir/"csv_writer.tsv");
+        c.write_header();
+        for(double v:x){c.write_line(v,v);}
+        c.close();
+
+        csv::Parallel_writer p;
+        p.add_column("x");
+        p.add_column("y");
+        if(precision){p.set_precision(1,*precision);}
+        p.set_write(dir/"parallel_writer.tsv");
+        p.write_header();
+        {
+            csv::Parallel_writer::Producer pr = p.producer();
+            for(double v:x){pr.write_line(v,v);}
+        }
+        p.close();
+
+        const auto a = lines_of(dir/"csv_writer.tsv");
+        const auto b = lines_of(dir/"parallel_writer.tsv");
+        check(a==b, "same text as Csv_writer, "+name+(a.size()>1 && b.size()>1 ? ", Csv_writer="+a[1]+", Parallel_writer="+b[1] : ""));
+    }
+}
+
+}
+
+
+int main(){
+    const std::filesystem::path dir = std::filesystem::temp_directory_path()/"csv_parallel_writer_test";
+    std::filesystem::create_directories(dir);
+
+    test_any(dir/"any.tsv");
+    test_sequence(dir/"sequence.tsv");
+    test_same_text(dir);
+
+    std::filesystem::remove_all(dir);
+    std::cout<<failures<<" failures\n";
+    return failures==0 ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+//The SIMD kernels of tools/simd_scan.hpp must give the results of the scalar kernels,
+//for every Isa supported by this cpu, on random lines with separators at the 16/32/64 bytes boundaries,
+//quotes, CR/LF, and max_fields limits. Returns 1 and prints the first mismatches on failure.
+
+#include "tools/simd_scan.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace{
+
+//splitmix64, see bench/csv_bench.cpp
+struct Rng{
+    uint64_t s;
+    uint64_t next(){
+        uint64_t z = (s += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z>>30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z>>27)) * 0x94d049bb133111ebULL;
+        return z ^ (z>>31);
+    }
+    uint64_t below(uint64_t n){return next()%n;}
+};
+
+const char *isa_name(csv::simd::Isa i){
+    switch(i){
+        case csv::simd::Isa::scalar : return "scalar";
+        case csv::simd::Isa::sse2   : return "sse2";
+        case csv::simd::Isa::avx2   : return "avx2";
+        case csv::simd::Isa::avx512 : return "avx512";
+    }
+    return "?";
+}
+
+size_t failures = 0;
+
+void fail(csv::simd::Isa isa, const char *kernel, const std::string &input, size_t max_fields){
+    if(++failures>10){return;}
+    std::cerr<<"mismatch : "<<kernel<<" "<<isa_name(isa)<<", max_fields="<<(max_fields==SIZE_MAX ? std::string("max") : std::to_string(max_fields))
+             <<", input("<<input.size()<<")=";
+    for(char c:input){
+        if     (c=='\n'){std::cerr<<"\\n";}
+        else if(c=='\r'){std::cerr<<"\\r";}
+        else            {std::cerr<<c;}
+    }
+    std::cerr<<"\n";
+}
+
+//fields as offsets, the views must point into the same buffer
+bool same(const char *b, const std::vector<std::string_view> &x, const std::vector<std::string_view> &y){
+    if(x.size()!=y.size()){return false;}
+    for(size_t i=0;i<x.size();++i){
+        if(x[i].data()-b!=y[i].data()-b || x[i].size()!=y[i].size()){return false;}
+    }
+    return true;
+}
+
+//a random line : mostly letters, with sep, quote, '\r' and endl. Some separators exactly at 16/32/64 bytes boundaries
+std::string random_input(Rng &rng, char sep, char endl, char quote){
+    static constexpr size_t boundaries[] = {15,16,17,31,32,33,63,64,65,127,128,129};
+    const size_t n = rng.below(4)==0 ? rng.below(16) : rng.below(300);
+    std::string s(n,'a');
+    const uint64_t density = 2+rng.below(12); //1 special char every density chars, on average
+    for(auto &c:s){
+        if(rng.below(density)!=0){c = static_cast<char>('a'+rng.below(26)); continue;}
+        switch(rng.below(8)){
+            case 0 : case 1 : case 2 : c=sep;   break;
+            case 3 : case 4 :          c=quote; break;
+            case 5 :                   c='\r';  break;
+            case 6 :                   c=endl;  break;
+            default:                   c=' ';   break;
+        }
+    }
+    for(size_t x:boundaries){
+        if(x<n && rng.below(2)==0){s[x] = rng.below(4)==0 ? endl : sep;}
+    }
+    return s;
+}
+
+}
+
+
+int main(){
+    using namespace csv::simd;
+
+    std::vector<Isa> isas;
+    for(Isa i : {Isa::sse2, Isa::avx2, Isa::avx512}){
+        if(static_cast<int>(i)<=static_cast<int>(best_isa())){isas.push_back(i);} //best_isa implies the smaller ones
+    }
+    std::cout<<"best isa : "<<isa_name(best_isa())<<"\n";
+
+    Rng rng{42};
+    const size_t max_fields_v[] = {SIZE_MAX, 0, 1, 2, 3, 7, 16};
+    std::vector<std::string_view> expected, got;
+    std::string buf;
+    size_t cases = 0;
+
+    for(size_t iter=0; iter<20000; ++iter){
+        const bool csv_like = rng.below(2)==0;
+        const char sep   = csv_like ? ',' : '\t';
+        const char endl  = rng.below(4)==0 ? '\r' : '\n';
+        const char quote = '"';
+        const std::string input = random_input(rng,sep,endl,quote);
+
+        //misaligned copies : the kernels use unaligned loads
+        const size_t shift = rng.below(64);
+        buf.assign(shift,'#');
+        buf+=input;
+        const char *b = buf.data()+shift;
+        const char *e = b+input.size();
+
+        const size_t max_fields = rng.below(3)==0 ? max_fields_v[rng.below(std::size(max_fields_v))] : SIZE_MAX;
+
+        for(Isa isa : isas){
+            ++cases;
+
+            expected.clear(); got.clear();
+            const char *x = split_line_scalar(b,e,sep,endl,expected,max_fields);
+            const char *y = split_line_kernel(isa)(b,e,sep,endl,got,max_fields);
+            if(x!=y || !same(b,expected,got)){fail(isa,"split_line",input,max_fields);}
+
+            expected.clear(); got.clear();
+            x = split_line_quoted_scalar(b,e,sep,endl,quote,expected,max_fields);
+            y = split_line_quoted_kernel(isa)(b,e,sep,endl,quote,got,max_fields);
+            if(x!=y || !same(b,expected,got)){fail(isa,"split_line_quoted",input,max_fields);}
+
+            for(char c : {sep,endl,quote,'\r'}){
+                if(count_scalar(b,e,c)!=count_kernel(isa)(b,e,c)){fail(isa,"count",input,max_fields);}
+            }
+        }
+    }
+
+    std::cout<<cases<<" cases, "<<failures<<" failures\n";
+    return failures==0 ? 0 : 1;
+}
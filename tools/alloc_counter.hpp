@@ -0,0 +1,69 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_ALLOC_COUNTER_HPP
+#define CSV_ALLOC_COUNTER_HPP
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+namespace csv{
+
+//USAGE :
+//in ONE .cpp file of the program, at global scope :
+//CSV_COUNT_ALLOCATIONS()
+//
+//then csv::allocation_count() is the number of calls to operator new so far.
+//Without CSV_COUNT_ALLOCATIONS(), it stays 0 : Stats::allocations is then always 0.
+
+inline std::atomic<size_t>& allocation_count(){
+    static std::atomic<size_t> n{0};
+    return n;
+}
+
+}
+
+
+//gcc sees free on a pointer returned by operator new, which is what the replacement does
+#if defined(__GNUC__) && !defined(__clang__)
+    #define CSV_ALLOC_COUNTER_PUSH _Pragma("GCC diagnostic push") _Pragma("GCC diagnostic ignored \"-Wmismatched-new-delete\"")
+    #define CSV_ALLOC_COUNTER_POP  _Pragma("GCC diagnostic pop")
+#else
+    #define CSV_ALLOC_COUNTER_PUSH
+    #define CSV_ALLOC_COUNTER_POP
+#endif
+
+#define CSV_COUNT_ALLOCATIONS() \
+    CSV_ALLOC_COUNTER_PUSH \
+    void* operator new(std::size_t n){ \
+        csv::allocation_count().fetch_add(1,std::memory_order_relaxed); \
+        if(void *p=std::malloc(n==0?1:n)){return p;} \
+        throw std::bad_alloc(); \
+    } \
+    void* operator new[](std::size_t n){return operator new(n);} \
+    void  operator delete  (void *p)noexcept{std::free(p);} \
+    void  operator delete[](void *p)noexcept{std::free(p);} \
+    void  operator delete  (void *p, std::size_t)noexcept{std::free(p);} \
+    void  operator delete[](void *p, std::size_t)noexcept{std::free(p);} \
+    CSV_ALLOC_COUNTER_POP
+
+
+#endif // CSV_ALLOC_COUNTER_HPP
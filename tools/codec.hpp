@@ -0,0 +1,480 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_CODEC_HPP
+#define CSV_CODEC_HPP
+
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+//CSV_HAS_ZLIB, CSV_HAS_ZSTD : set by the build (CMakeLists.txt), otherwise the header decides. Link with -lz, -lzstd
+#ifndef CSV_HAS_ZLIB
+    #if __has_include(<zlib.h>)
+        #define CSV_HAS_ZLIB 1
+    #else
+        #define CSV_HAS_ZLIB 0
+    #endif
+#endif
+
+#ifndef CSV_HAS_ZSTD
+    #if __has_include(<zstd.h>)
+        #define CSV_HAS_ZSTD 1
+    #else
+        #define CSV_HAS_ZSTD 0
+    #endif
+#endif
+
+#if CSV_HAS_ZLIB
+    #include <zlib.h>
+#endif
+#if CSV_HAS_ZSTD
+    #include <zstd.h>
+#endif
+
+
+namespace csv{
+
+//USAGE :
+//read  : Csv_reader::read(path) decompresses gzip and zstd files, detected by their magic bytes.
+//        A Read_ahead thread decompresses blocks while the calling thread parses the previous ones.
+//write : Csv_writer::set_write("out.tsv.gz") compresses, detected by the extension (.gz .zst).
+//        Fd_out gives its full buffers to a Block_compressor : each buffer is compressed by a pool of threads
+//        as an independent gzip member or zstd frame (as pigz), and written in order.
+//        The output is a standard file : gzip -d, zcat, zstd -d read concatenated members and frames.
+//
+//csv::Compression c;  //writers : Csv_writer::compression, Parallel_writer::Options::compression
+//c.codec   = csv::Codec::zstd; //detect (default) : from the extension, none : never
+//c.level   = 3;                //0 : default of the codec
+//c.threads = 4;                //0 : std::thread::hardware_concurrency()
+
+enum class Codec{
+    detect, //read : magic bytes, write : extension
+    none,
+    gzip,
+    zstd
+};
+
+struct Compression{
+    Codec  codec   = Codec::detect;
+    int    level   = 0;
+    size_t threads = 0;
+};
+
+
+inline const char* codec_name(Codec c){
+    switch(c){
+        case Codec::detect : return "detect";
+        case Codec::none   : return "none";
+        case Codec::gzip   : return "gzip";
+        case Codec::zstd   : return "zstd";
+    }
+    return "?";
+}
+
+
+//.gz .gzip .zst .zstd, otherwise none
+inline Codec codec_of_extension(const std::filesystem::path &p){
+    const std::string x = p.extension().string();
+    if(x==".gz"  || x==".gzip"){return Codec::gzip;}
+    if(x==".zst" || x==".zstd"){return Codec::zstd;}
+    return Codec::none;
+}
+
+//magic bytes of the file : 1f 8b (gzip), 28 b5 2f fd (zstd), otherwise none. A missing file is none
+inline Codec codec_of_file(const std::filesystem::path &p){
+    std::ifstream in(p,std::ios::binary);
+    unsigned char m[4]={0,0,0,0};
+    in.read(reinterpret_cast<char*>(m),4);
+    const size_t n = in ? 4 : static_cast<size_t>(in.gcount());
+    if(n>=2 && m[0]==0x1f && m[1]==0x8b){return Codec::gzip;}
+    if(n>=4 && m[0]==0x28 && m[1]==0xb5 && m[2]==0x2f && m[3]==0xfd){return Codec::zstd;}
+    return Codec::none;
+}
+
+//codec of a writer : c.codec, or the extension of p
+inline Codec output_codec(const Compression &c, const std::filesystem::path &p){
+    return c.codec==Codec::detect ? codec_of_extension(p) : c.codec;
+}
+
+
+namespace detail{
+
+inline void check_codec(Codec c, const std::string &name){
+    if(c==Codec::gzip && !CSV_HAS_ZLIB){throw std::runtime_error("Error in csv codec : gzip is not supported by this build (zlib). path="+name);}
+    if(c==Codec::zstd && !CSV_HAS_ZSTD){throw std::runtime_error("Error in csv codec : zstd is not supported by this build (libzstd). path="+name);}
+}
+
+
+//compressed file => decompressed bytes
+class Decoder{
+public:
+    Decoder(const std::filesystem::path &p, Codec c):codec(c),name(p.generic_string()),in(p,std::ios::binary),ibuf(new char[icap]){
+        check_codec(codec,name);
+        if(!in){throw std::runtime_error("Error in csv::detail::Decoder, cannot open file. path="+name);}
+        #if CSV_HAS_ZLIB
+        if(codec==Codec::gzip && inflateInit2(&z,15+32)!=Z_OK){throw std::runtime_error("Error in csv::detail::Decoder, inflateInit2 failed. path="+name);}
+        #endif
+        #if CSV_HAS_ZSTD
+        if(codec==Codec::zstd){
+            zd = ZSTD_createDStream();
+            if(zd==nullptr){throw std::runtime_error("Error in csv::detail::Decoder, ZSTD_createDStream failed. path="+name);}
+        }
+        #endif
+    }
+
+    ~Decoder(){
+        #if CSV_HAS_ZLIB
+        if(codec==Codec::gzip){inflateEnd(&z);}
+        #endif
+        #if CSV_HAS_ZSTD
+        if(zd!=nullptr){ZSTD_freeDStream(zd);}
+        #endif
+    }
+
+    Decoder(const Decoder&)=delete;
+    Decoder& operator=(const Decoder&)=delete;
+
+    //fills [b,b+n), less than n : end of the file. Concatenated members (frames) are read one after the other
+    size_t read(char *b, size_t n){
+        size_t done=0;
+        while(done<n){
+            if(in_size==in_pos){
+                if(!refill()){
+                    if(in_frame){throw std::runtime_error("Error in csv::detail::Decoder, truncated "+std::string(codec_name(codec))+" file. path="+name);}
+                    break;
+                }
+            }
+            done+=step(b+done,n-done);
+        }
+        return done;
+    }
+
+private:
+    static constexpr size_t icap = 1<<18;
+
+    Codec       codec;
+    std::string name;
+    std::ifstream in;
+    std::unique_ptr<char[]> ibuf;
+    size_t in_size  = 0;
+    size_t in_pos   = 0;
+    bool   in_frame = false; //inside a member (frame) : the end of the file is an error
+
+    #if CSV_HAS_ZLIB
+    z_stream z{};
+    #endif
+    #if CSV_HAS_ZSTD
+    ZSTD_DStream *zd = nullptr;
+    #endif
+
+    bool refill(){
+        in.read(ibuf.get(),static_cast<std::streamsize>(icap));
+        in_size = static_cast<size_t>(in.gcount());
+        in_pos  = 0;
+        if(in_size==0 && in.bad()){throw std::runtime_error("Error in csv::detail::Decoder, cannot read file. path="+name);}
+        return in_size!=0;
+    }
+
+    //decompress from the input buffer to [b,b+n), returns the bytes written
+    size_t step([[maybe_unused]] char *b, [[maybe_unused]] size_t n){
+        #if CSV_HAS_ZLIB
+        if(codec==Codec::gzip){
+            const size_t avail_in = in_size-in_pos;
+            z.next_in   = reinterpret_cast<Bytef*>(ibuf.get()+in_pos);
+            z.avail_in  = static_cast<uInt>(avail_in);
+            z.next_out  = reinterpret_cast<Bytef*>(b);
+            z.avail_out = static_cast<uInt>(std::min<size_t>(n,UINT_MAX));
+            const uInt out_before = z.avail_out;
+            in_frame = true;
+            const int r = inflate(&z,Z_NO_FLUSH);
+            in_pos += avail_in-z.avail_in;
+            if(r==Z_STREAM_END){in_frame=false; inflateReset(&z);} //next member, if any
+            else if(r!=Z_OK && r!=Z_BUF_ERROR){
+                throw std::runtime_error("Error in csv::detail::Decoder, corrupted gzip file. path="+name);
+            }
+            return out_before-z.avail_out;
+        }
+        #endif
+        #if CSV_HAS_ZSTD
+        if(codec==Codec::zstd){
+            ZSTD_inBuffer  i{ibuf.get(),in_size,in_pos};
+            ZSTD_outBuffer o{b,n,0};
+            const size_t r = ZSTD_decompressStream(zd,&o,&i);
+            if(ZSTD_isError(r)){throw std::runtime_error("Error in csv::detail::Decoder, corrupted zstd file. path="+name+", error="+ZSTD_getErrorName(r));}
+            in_pos   = i.pos;
+            in_frame = (r!=0); //0 : a frame is complete
+            return o.pos;
+        }
+        #endif
+        throw std::runtime_error("Error in csv::detail::Decoder, unsupported codec. path="+name);
+    }
+};
+
+
+//one block => one complete gzip member or zstd frame. One encoder per thread
+class Encoder{
+public:
+    Encoder(Codec c, int level_, const std::string &name_):codec(c),level(level_),name(name_){
+        check_codec(codec,name);
+        #if CSV_HAS_ZLIB
+        if(codec==Codec::gzip && deflateInit2(&z,level!=0 ? level : Z_DEFAULT_COMPRESSION,Z_DEFLATED,15+16,8,Z_DEFAULT_STRATEGY)!=Z_OK){
+            throw std::runtime_error("Error in csv::detail::Encoder, deflateInit2 failed. path="+name);
+        }
+        #endif
+        #if CSV_HAS_ZSTD
+        if(codec==Codec::zstd){
+            zc = ZSTD_createCCtx();
+            if(zc==nullptr){throw std::runtime_error("Error in csv::detail::Encoder, ZSTD_createCCtx failed. path="+name);}
+        }
+        #endif
+    }
+
+    ~Encoder(){
+        #if CSV_HAS_ZLIB
+        if(codec==Codec::gzip){deflateEnd(&z);}
+        #endif
+        #if CSV_HAS_ZSTD
+        if(zc!=nullptr){ZSTD_freeCCtx(zc);}
+        #endif
+    }
+
+    Encoder(const Encoder&)=delete;
+    Encoder& operator=(const Encoder&)=delete;
+
+    void encode([[maybe_unused]] const char *s, [[maybe_unused]] size_t n, [[maybe_unused]] std::string &out){
+        #if CSV_HAS_ZLIB
+        if(codec==Codec::gzip){
+            deflateReset(&z);
+            out.resize(deflateBound(&z,static_cast<uLong>(n)));
+            z.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(s));
+            z.avail_in  = static_cast<uInt>(n);
+            z.next_out  = reinterpret_cast<Bytef*>(out.data());
+            z.avail_out = static_cast<uInt>(out.size());
+            if(deflate(&z,Z_FINISH)!=Z_STREAM_END){throw std::runtime_error("Error in csv::detail::Encoder, deflate failed. path="+name);}
+            out.resize(out.size()-z.avail_out);
+            return;
+        }
+        #endif
+        #if CSV_HAS_ZSTD
+        if(codec==Codec::zstd){
+            out.resize(ZSTD_compressBound(n));
+            const size_t r = ZSTD_compressCCtx(zc,out.data(),out.size(),s,n,level!=0 ? level : ZSTD_CLEVEL_DEFAULT);
+            if(ZSTD_isError(r)){throw std::runtime_error("Error in csv::detail::Encoder, zstd compression failed. path="+name+", error="+ZSTD_getErrorName(r));}
+            out.resize(r);
+            return;
+        }
+        #endif
+        throw std::runtime_error("Error in csv::detail::Encoder, unsupported codec. path="+name);
+    }
+
+private:
+    Codec       codec;
+    int         level;
+    std::string name;
+    #if CSV_HAS_ZLIB
+    z_stream z{};
+    #endif
+    #if CSV_HAS_ZSTD
+    ZSTD_CCtx *zc = nullptr;
+    #endif
+};
+
+}//end detail
+
+
+
+
+//source of Read_ahead : the decompressed bytes of p
+inline std::function<size_t(char*,size_t)> decompress_source(const std::filesystem::path &p, Codec c){
+    auto d = std::make_shared<detail::Decoder>(p,c);
+    return [d](char *b, size_t n){return d->read(b,n);};
+}
+
+
+
+
+//compresses blocks on a pool of threads, writes them in order with write.
+//At most 2 blocks per thread wait or are compressed : push blocks when the threads are behind.
+class Block_compressor{
+public:
+    typedef std::function<void(const char*, size_t)> Fn_write;
+
+    Block_compressor(Codec c, const Compression &opt, Fn_write write_, std::string name_);
+    ~Block_compressor(){stop();}
+
+    Block_compressor(const Block_compressor&)=delete;
+    Block_compressor& operator=(const Block_compressor&)=delete;
+
+    //takes the n bytes of buf (capacity bytes), buf is replaced by a free buffer of at least capacity bytes
+    void push(std::unique_ptr<char[]> &buf, size_t n, size_t capacity);
+
+    //waits for the blocks, writes them. The output of no block is an empty member (frame). Rethrows errors of the threads
+    void close();
+
+private:
+    struct Buffer{
+        std::unique_ptr<char[]> data;
+        size_t capacity = 0;
+    };
+    struct Job{
+        Buffer      in;
+        size_t      size = 0;
+        std::string out;
+        bool        done = false;
+    };
+
+    Codec       codec;
+    int         level;
+    Fn_write    write;
+    std::string name;
+    size_t      max_jobs;
+
+    std::mutex              m;
+    std::condition_variable cv;
+    std::deque<Job>         jobs;         //in order, jobs.front() is block first_seq
+    size_t                  first_seq = 0;
+    size_t                  next_seq  = 0; //next block to compress
+    size_t                  pushed    = 0;
+    bool                    writing   = false; //a thread writes the done blocks at the front
+    bool                    stopping  = false;
+    bool                    closed    = false;
+    std::vector<Buffer>     free_v;
+    std::exception_ptr      error;
+    std::vector<std::thread> threads;
+
+    void run();
+    void stop();
+};
+
+
+
+
+inline Block_compressor::Block_compressor(Codec c, const Compression &opt, Fn_write write_, std::string name_):
+    codec(c),level(opt.level),write(std::move(write_)),name(std::move(name_))
+{
+    detail::check_codec(codec,name);
+    const size_t n = std::max<size_t>(opt.threads!=0 ? opt.threads : std::thread::hardware_concurrency(),1);
+    max_jobs = 2*n;
+    for(size_t i=0;i<n;++i){threads.emplace_back([this](){run();});}
+}
+
+
+inline void Block_compressor::run(){
+    try{
+        detail::Encoder enc(codec,level,name);
+        std::unique_lock<std::mutex> lk(m);
+        for(;;){
+            cv.wait(lk,[&](){return stopping || error || next_seq<first_seq+jobs.size();});
+            if(error || next_seq>=first_seq+jobs.size()){return;} //stopping, and nothing left
+
+            Job &j = jobs[next_seq++ - first_seq]; //stays valid : only the done jobs before it are removed
+            lk.unlock();
+            enc.encode(j.in.data.get(),j.size,j.out);
+            lk.lock();
+            j.done = true;
+            free_v.push_back(std::move(j.in));
+
+            //write the done blocks at the front, in order. The lock is released while writing
+            if(!writing){
+                writing = true;
+                while(!jobs.empty() && jobs.front().done){
+                    std::string out = std::move(jobs.front().out);
+                    jobs.pop_front();
+                    ++first_seq;
+                    cv.notify_all(); //room for push
+                    lk.unlock();
+                    write(out.data(),out.size());
+                    lk.lock();
+                }
+                writing = false;
+            }
+            cv.notify_all();
+        }
+    }catch(...){
+        std::lock_guard<std::mutex> lk(m);
+        if(!error){error = std::current_exception();}
+        writing = false;
+        cv.notify_all();
+    }
+}
+
+
+inline void Block_compressor::push(std::unique_ptr<char[]> &buf, size_t n, size_t capacity){
+    std::unique_lock<std::mutex> lk(m);
+    cv.wait(lk,[&](){return error || jobs.size()<max_jobs;});
+    if(error){std::rethrow_exception(error);}
+
+    jobs.push_back(Job{Buffer{std::move(buf),capacity},n,std::string(),false});
+    ++pushed;
+
+    auto x = std::find_if(free_v.begin(),free_v.end(),[&](const Buffer &b){return b.capacity>=capacity;});
+    if(x!=free_v.end()){
+        buf = std::move(x->data);
+        free_v.erase(x);
+    }
+    lk.unlock();
+    cv.notify_all();
+    if(buf==nullptr){buf.reset(new char[capacity]);}
+}
+
+
+inline void Block_compressor::close(){
+    if(closed){return;}
+    closed = true;
+    {
+        std::unique_lock<std::mutex> lk(m);
+        cv.wait(lk,[&](){return error || (jobs.empty() && !writing);});
+    }
+    stop();
+    if(error){std::rethrow_exception(error);}
+
+    if(pushed==0){ //a valid empty file
+        detail::Encoder enc(codec,level,name);
+        std::string out;
+        enc.encode(nullptr,0,out);
+        write(out.data(),out.size());
+    }
+}
+
+
+inline void Block_compressor::stop(){
+    {
+        std::lock_guard<std::mutex> lk(m);
+        stopping = true;
+    }
+    cv.notify_all();
+    for(auto &t:threads){if(t.joinable()){t.join();}}
+}
+
+
+}
+#endif // CSV_CODEC_HPP
@@ -0,0 +1,185 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_DICTIONARY_HPP
+#define CSV_DICTIONARY_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+
+namespace csv{
+
+//USAGE :
+//csv::Dictionary d(1000);                  //at most 1000 distinct values, SIZE_MAX : no limit
+//uint32_t id = d.intern("FR");             //0, 1, 2 ... in order of first appearance
+//if(id==csv::Dictionary::npos){...}        //the dictionary is full and "FR" is not in it
+//std::string_view v = d[id];               //stable : valid until clear or destruction
+//
+//Values are copied once in an arena of 64 KB blocks, and found again with an open addressing
+//table of ids. The table keeps the hash of each value : a probe compares the hash, then the size,
+//then the bytes (memcmp, vectorized by the C library).
+
+class Dictionary{
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    explicit Dictionary(size_t max_size_=SIZE_MAX):max_size(std::min<size_t>(max_size_,npos)){}
+
+    Dictionary(const Dictionary&)=delete;
+    Dictionary& operator=(const Dictionary&)=delete;
+    Dictionary(Dictionary&&)=default;
+    Dictionary& operator=(Dictionary&&)=default;
+
+    //id of s, s is added if needed. npos : s is new and the dictionary is full
+    uint32_t intern(std::string_view s);
+
+    //id of s, or npos
+    uint32_t find(std::string_view s)const;
+
+    std::string_view operator[](uint32_t id)const{return values[id];}
+    size_t size()const{return values.size();}
+    bool   full()const{return values.size()>=max_size;}
+    size_t overflow()const{return overflow_count;} //calls to intern that returned npos
+
+    void clear(){
+        values.clear(); hashes.clear(); slots.clear();
+        blocks.clear(); block_used=block_size; overflow_count=0;
+    }
+
+    static uint64_t hash(std::string_view s);
+
+private:
+    static constexpr size_t block_size = 64<<10;
+
+    size_t max_size;
+    size_t overflow_count = 0;
+
+    std::vector<std::string_view> values;  //id => value, in the arena
+    std::vector<uint64_t>         hashes;  //id => hash
+    std::vector<uint32_t>         slots;   //open addressing, id+1, 0 is empty. Size : power of 2
+
+    std::vector<std::unique_ptr<char[]>> blocks; //the arena
+    size_t block_used = block_size;
+
+    const char* store(std::string_view s);
+    void grow();
+
+    //slot of s, or the empty slot where it goes
+    size_t probe(std::string_view s, uint64_t h)const{
+        const size_t mask = slots.size()-1;
+        for(size_t i=static_cast<size_t>(h)&mask;;i=(i+1)&mask){
+            const uint32_t x = slots[i];
+            if(x==0){return i;}
+            const std::string_view v = values[x-1];
+            if(hashes[x-1]==h && v.size()==s.size() && std::memcmp(v.data(),s.data(),s.size())==0){return i;}
+        }
+    }
+};
+
+
+
+
+//8 bytes at a time, multiply and fold
+inline uint64_t Dictionary::hash(std::string_view s){
+    constexpr uint64_t k = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = s.size()*k;
+    const char *p = s.data();
+    size_t n = s.size();
+    for(;n>=8;n-=8,p+=8){
+        uint64_t v;
+        std::memcpy(&v,p,8);
+        h = (h^v)*k;
+        h ^= h>>32;
+    }
+    if(n!=0){
+        uint64_t v=0;
+        std::memcpy(&v,p,n);
+        h = (h^v)*k;
+        h ^= h>>32;
+    }
+    h *= 0xBF58476D1CE4E5B9ULL;
+    return h ^ (h>>31);
+}
+
+
+inline const char* Dictionary::store(std::string_view s){
+    if(s.empty()){return "";} //no block : there may be none yet
+    if(s.size()>block_size/4){ //large value : its own block, the current block stays open
+        char *d = new char[s.size()];
+        blocks.emplace(blocks.empty() ? blocks.end() : blocks.end()-1, d);
+        std::memcpy(d,s.data(),s.size());
+        return d;
+    }
+    if(block_used+s.size()>block_size){
+        blocks.emplace_back(new char[block_size]);
+        block_used=0;
+    }
+    char *d = blocks.back().get()+block_used;
+    std::memcpy(d,s.data(),s.size());
+    block_used+=s.size();
+    return d;
+}
+
+
+inline void Dictionary::grow(){
+    std::vector<uint32_t> s(slots.empty() ? 64 : slots.size()*2, 0);
+    const size_t mask = s.size()-1;
+    for(uint32_t id=0; id<values.size(); ++id){
+        size_t i = static_cast<size_t>(hashes[id])&mask;
+        while(s[i]!=0){i=(i+1)&mask;}
+        s[i]=id+1;
+    }
+    slots.swap(s);
+}
+
+
+inline uint32_t Dictionary::find(std::string_view s)const{
+    if(slots.empty()){return npos;}
+    const uint32_t x = slots[probe(s,hash(s))];
+    return x==0 ? npos : x-1;
+}
+
+
+inline uint32_t Dictionary::intern(std::string_view s){
+    if(slots.empty()){grow();}
+    const uint64_t h = hash(s);
+    size_t i = probe(s,h);
+    if(slots[i]!=0){return slots[i]-1;}
+
+    if(full()){++overflow_count; return npos;}
+    if((values.size()+1)*2>slots.size()){ //load factor 1/2
+        grow();
+        i = probe(s,h);
+    }
+
+    const uint32_t id = static_cast<uint32_t>(values.size());
+    values.emplace_back(store(s),s.size());
+    hashes.push_back(h);
+    slots[i]=id+1;
+    return id;
+}
+
+
+}
+#endif // CSV_DICTIONARY_HPP
@@ -0,0 +1,259 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_FD_OUT_HPP
+#define CSV_FD_OUT_HPP
+
+#include "codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define CSV_HAS_FD_OUT 1
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/uio.h>
+    #include <cerrno>
+#else
+    #define CSV_HAS_FD_OUT 0
+    #include <fstream>
+#endif
+
+
+namespace csv{
+
+//USAGE :
+//csv::Fd_out o("out.tsv");  //create or truncate
+//o.append("abc");           //memcpy in a user space buffer
+//o.put('\n');
+//o.close();                 //flush and close, throws on error
+//
+//The buffer is written with write(2). Large appends are written with the buffer in one writev.
+//preallocate reserves disk space with fallocate (linux), the file size is not changed.
+//On other platforms, the buffer is written to a std::ofstream.
+//
+//Compressed : csv::Fd_out o("out.tsv.gz", 1<<20, 0, compression); //codec detect : from the extension
+//each full buffer is compressed by a Block_compressor thread (see codec.hpp), the calling thread fills the next one.
+
+class Fd_out{
+public:
+    explicit Fd_out(const std::filesystem::path &p, size_t buffer_size=1<<20, size_t preallocate=0, const Compression &compression=Compression());
+    ~Fd_out(){try{close();}catch(...){}}
+
+    Fd_out(const Fd_out&)=delete;
+    Fd_out& operator=(const Fd_out&)=delete;
+
+    void put(char c){
+        if(used==capacity)[[unlikely]]{flush();}
+        buf[used++]=c;
+    }
+
+    void append(const char *s, size_t n){
+        if(n<=capacity-used)[[likely]]{
+            std::memcpy(buf.get()+used,s,n);
+            used+=n;
+            return;
+        }
+        append_large(s,n);
+    }
+    void append(std::string_view s){append(s.data(),s.size());}
+
+    //space for at least n bytes, commit them with commit(n)
+    char* reserve(size_t n){
+        if(n>capacity-used){flush();}
+        if(n>capacity){grow(n);}
+        return buf.get()+used;
+    }
+    void commit(size_t n){used+=n;}
+
+    void flush();
+    void close();
+    bool is_open()const{return open;}
+
+private:
+    std::string             name;
+    std::unique_ptr<char[]> buf;
+    size_t                  capacity = 0;
+    size_t                  used     = 0;
+    bool                    open     = false;
+    std::unique_ptr<Block_compressor> packer; //nullptr : not compressed
+
+    #if CSV_HAS_FD_OUT
+    int fd=-1;
+    void write_all(const char *s, size_t n);
+    #else
+    std::ofstream out;
+    #endif
+
+    void append_large(const char *s, size_t n);
+    void grow(size_t n){
+        std::unique_ptr<char[]> b(new char[n]);
+        std::memcpy(b.get(),buf.get(),used);
+        buf=std::move(b);
+        capacity=n;
+    }
+};
+
+
+
+
+inline Fd_out::Fd_out(const std::filesystem::path &p, size_t buffer_size, size_t preallocate, const Compression &compression):
+    name(p.generic_string()),buf(new char[std::max<size_t>(buffer_size,1)]),capacity(std::max<size_t>(buffer_size,1))
+{
+    #if CSV_HAS_FD_OUT
+    fd = ::open(p.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0666);
+    if(fd<0){throw std::runtime_error("Error in Fd_out, cannot open file. path="+name);}
+    #if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    if(preallocate!=0){::fallocate(fd,FALLOC_FL_KEEP_SIZE,0,static_cast<off_t>(preallocate));} //only a hint, ignore errors
+    #else
+    (void)preallocate;
+    #endif
+    #else
+    (void)preallocate;
+    out.open(p,std::ios::binary);
+    if(!out){throw std::runtime_error("Error in Fd_out, cannot open file. path="+name);}
+    #endif
+    open=true;
+
+    const Codec c = output_codec(compression,p);
+    if(c!=Codec::none){
+        #if CSV_HAS_FD_OUT
+        auto write = [this](const char *s, size_t n){write_all(s,n);};
+        #else
+        auto write = [this](const char *s, size_t n){
+            out.write(s,static_cast<std::streamsize>(n));
+            if(!out){throw std::runtime_error("Error in Fd_out, cannot write. path="+name);}
+        };
+        #endif
+        try{
+            packer = std::make_unique<Block_compressor>(c,compression,write,name);
+        }catch(...){
+            #if CSV_HAS_FD_OUT
+            ::close(fd);
+            #endif
+            open=false;
+            throw;
+        }
+    }
+}
+
+
+#if CSV_HAS_FD_OUT
+inline void Fd_out::write_all(const char *s, size_t n){
+    while(n!=0){
+        ssize_t r = ::write(fd,s,n);
+        if(r<0){
+            if(errno==EINTR){continue;}
+            throw std::runtime_error("Error in Fd_out, cannot write. path="+name);
+        }
+        s+=r;
+        n-=static_cast<size_t>(r);
+    }
+}
+#endif
+
+
+inline void Fd_out::flush(){
+    if(used==0){return;}
+    if(packer){
+        packer->push(buf,used,capacity);
+        used=0;
+        return;
+    }
+    #if CSV_HAS_FD_OUT
+    write_all(buf.get(),used);
+    #else
+    out.write(buf.get(),static_cast<std::streamsize>(used));
+    if(!out){throw std::runtime_error("Error in Fd_out, cannot write. path="+name);}
+    #endif
+    used=0;
+}
+
+
+inline void Fd_out::append_large(const char *s, size_t n){
+    if(packer){ //blocks of capacity bytes
+        while(n!=0){
+            const size_t k = std::min(n,capacity-used);
+            std::memcpy(buf.get()+used,s,k);
+            used+=k; s+=k; n-=k;
+            if(used==capacity){flush();}
+        }
+        return;
+    }
+
+    #if CSV_HAS_FD_OUT
+    //buffer + s in one system call
+    iovec v[2];
+    v[0].iov_base = buf.get();
+    v[0].iov_len  = used;
+    v[1].iov_base = const_cast<char*>(s);
+    v[1].iov_len  = n;
+
+    ssize_t r;
+    do{ r = ::writev(fd,v,2); }while(r<0 && errno==EINTR);
+    if(r<0){throw std::runtime_error("Error in Fd_out, cannot write. path="+name);}
+
+    //partial write : write the rest
+    size_t done = static_cast<size_t>(r);
+    if(done<used){
+        write_all(buf.get()+done,used-done);
+        done=used;
+    }
+    write_all(s+(done-used),n-(done-used));
+    used=0;
+    #else
+    flush();
+    out.write(s,static_cast<std::streamsize>(n));
+    if(!out){throw std::runtime_error("Error in Fd_out, cannot write. path="+name);}
+    #endif
+}
+
+
+inline void Fd_out::close(){
+    if(!open){return;}
+    open=false;
+    #if CSV_HAS_FD_OUT
+    try{
+        flush();
+        if(packer){packer->close();}
+    }catch(...){
+        ::close(fd);
+        fd=-1;
+        throw;
+    }
+    int r = ::close(fd);
+    fd=-1;
+    if(r!=0){throw std::runtime_error("Error in Fd_out, cannot close. path="+name);}
+    #else
+    flush();
+    if(packer){packer->close();}
+    out.close();
+    if(!out){throw std::runtime_error("Error in Fd_out, cannot close. path="+name);}
+    #endif
+}
+
+
+}
+#endif // CSV_FD_OUT_HPP
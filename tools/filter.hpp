@@ -0,0 +1,89 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_FILTER_HPP
+#define CSV_FILTER_HPP
+
+#include "dictionary.hpp"
+#include "parse.hpp"
+
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace csv{
+namespace filter{
+
+//USAGE :
+//r.add_filter("status", csv::filter::equal("OK"));
+//r.add_filter("region", csv::filter::in({"EU","US"}));
+//r.add_filter("code",   csv::filter::prefix("FR-"));
+//r.add_filter("price",  csv::filter::range(10, 100));          //numbers in [10,100], other tokens are rejected
+//r.add_filter("name",   [](std::string_view s){return s.size()>3;}); //any predicate
+//
+//Predicates get the field after the field policies of Csv_reader (unquoted if quoted, at_token is not applied).
+
+typedef std::function<bool(std::string_view)> Fn;
+
+
+inline Fn equal(std::string v){
+    return [v=std::move(v)](std::string_view s){return s==v;};
+}
+
+
+inline Fn prefix(std::string v){
+    return [v=std::move(v)](std::string_view s){return s.substr(0,v.size())==v;};
+}
+
+
+//a few values : linear scan, otherwise a Dictionary lookup
+inline Fn in(std::vector<std::string> v){
+    if(v.size()<=8){
+        return [v=std::move(v)](std::string_view s){
+            for(const auto &x:v){if(x==s){return true;}}
+            return false;
+        };
+    }
+    auto d = std::make_shared<Dictionary>();
+    for(const auto &x:v){d->intern(x);}
+    return [d](std::string_view s){return d->find(s)!=Dictionary::npos;};
+}
+
+inline Fn in(std::initializer_list<std::string_view> v){
+    return in(std::vector<std::string>(v.begin(),v.end()));
+}
+
+
+//lo <= s <= hi, s is parsed with csv::parse::floating
+inline Fn range(double lo, double hi){
+    return [lo,hi](std::string_view s){
+        double x;
+        return csv::parse::floating(s,x) && lo<=x && x<=hi;
+    };
+}
+
+
+}//end filter
+}//end csv
+
+#endif // CSV_FILTER_HPP
@@ -0,0 +1,209 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_LINE_INDEX_HPP
+#define CSV_LINE_INDEX_HPP
+
+#include "simd_scan.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+
+namespace csv{
+
+//USAGE :
+//csv::Line_index x = csv::Line_index::get("big.tsv", 1<<16, '\n'); //loads big.tsv.idx, or builds and saves it
+//size_t n = x.lines;          //data lines (header excluded)
+//uint64_t o = x.offsets[j];   //byte offset of the line j*step (line 0 is the header)
+//
+//The index is built in one pass : simd::count on 64 KB blocks, memchr only in the blocks where a
+//multiple of step is reached. With quoted=true, endl between quotes don't end a line (slower pass).
+//The sidecar file stores the size and the modification time of the file : a modified file is indexed again.
+//The sidecar uses the native endianness. If it cannot be written, the index is only kept in memory.
+
+class Line_index{
+public:
+    size_t                step     = 0;
+    char                  endl     = '\n';
+    bool                  quoted   = false;
+    char                  quote    = '"';
+    uint64_t              file_size= 0;
+    int64_t               mtime    = 0;
+    size_t                lines    = 0; //data lines
+    std::vector<uint64_t> offsets;      //offsets[j] : begin of the line j*step
+
+    static std::filesystem::path sidecar(const std::filesystem::path &p){
+        std::filesystem::path r = p;
+        r += ".idx";
+        return r;
+    }
+
+    static Line_index build(const std::filesystem::path &p, std::string_view buffer, size_t step, char endl, bool quoted=false, char quote='"');
+
+    //the sidecar if it matches the file, otherwise build and save
+    static Line_index get(const std::filesystem::path &p, std::string_view buffer, size_t step, char endl, bool quoted=false, char quote='"');
+
+    bool save(const std::filesystem::path &idx)const;
+    bool load(const std::filesystem::path &idx); //false if the sidecar is missing or invalid
+
+    //the index describes the current version of p, with these options
+    bool matches(const std::filesystem::path &p, size_t step_, char endl_, bool quoted_, char quote_)const;
+
+private:
+    static constexpr char magic[8] = {'C','S','V','I','D','X','1','\0'};
+    static int64_t mtime_of(const std::filesystem::path &p){
+        std::error_code ec;
+        auto t = std::filesystem::last_write_time(p,ec);
+        return ec ? 0 : static_cast<int64_t>(t.time_since_epoch().count());
+    }
+};
+
+
+
+
+inline Line_index Line_index::build(const std::filesystem::path &p, std::string_view buffer, size_t step_, char endl_, bool quoted_, char quote_){
+    Line_index x;
+    x.step      = std::max<size_t>(step_,1);
+    x.endl      = endl_;
+    x.quoted    = quoted_;
+    x.quote     = quote_;
+    x.file_size = buffer.size();
+    x.mtime     = mtime_of(p);
+    x.offsets.push_back(0);
+
+    const char *b = buffer.data();
+    const char *e = b+buffer.size();
+    if(b==e){return x;}
+
+    size_t ends = 0;       //endl that end a line
+    size_t next = x.step;  //record the line that starts after the next-th endl
+    bool   tail = e[-1]!=endl_; //the last line has no endl
+
+    if(!quoted_){
+        constexpr size_t block = 64<<10;
+        for(const char *p0=b; p0!=e;){
+            const char *p1 = p0 + std::min<size_t>(block,static_cast<size_t>(e-p0));
+            const size_t c = csv::simd::count(p0,p1,endl_);
+            if(ends+c<next){ends+=c; p0=p1; continue;}
+
+            //a multiple of step is in this block
+            for(const char *q=p0;;){
+                q = static_cast<const char*>(std::memchr(q,endl_,static_cast<size_t>(p1-q)));
+                if(q==nullptr){break;}
+                ++q;
+                if(++ends==next){
+                    if(q!=e){x.offsets.push_back(static_cast<uint64_t>(q-b));}
+                    next+=x.step;
+                }
+            }
+            p0=p1;
+        }
+    }else{
+        std::vector<std::string_view> tmp;
+        for(const char *q=b; q!=e;){
+            tmp.clear();
+            const char *l = csv::simd::split_line_quoted(q,e,endl_,endl_,quote_,tmp,0); //no field : sep is not used
+            if(l==e){tail=true; break;}
+            q = l+1;
+            if(++ends==next){
+                if(q!=e){x.offsets.push_back(static_cast<uint64_t>(q-b));}
+                next+=x.step;
+            }
+        }
+    }
+
+    //lines : endl count, plus a last line without endl, minus the header
+    const size_t all = ends + (tail ? 1 : 0);
+    x.lines = all==0 ? 0 : all-1;
+    return x;
+}
+
+
+inline bool Line_index::matches(const std::filesystem::path &p, size_t step_, char endl_, bool quoted_, char quote_)const{
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(p,ec);
+    if(ec){return false;}
+    return step==std::max<size_t>(step_,1) && endl==endl_ && quoted==quoted_ && (!quoted || quote==quote_)
+        && file_size==size && mtime==mtime_of(p);
+}
+
+
+inline bool Line_index::save(const std::filesystem::path &idx)const{
+    std::ofstream o(idx,std::ios::binary|std::ios::trunc);
+    if(!o){return false;}
+
+    const uint64_t h[] = {static_cast<uint64_t>(step), file_size, static_cast<uint64_t>(mtime), static_cast<uint64_t>(lines), static_cast<uint64_t>(offsets.size())};
+    const char     c[] = {endl, static_cast<char>(quoted), quote, 0, 0, 0, 0, 0};
+    o.write(magic,sizeof(magic));
+    o.write(reinterpret_cast<const char*>(h),sizeof(h));
+    o.write(c,sizeof(c));
+    o.write(reinterpret_cast<const char*>(offsets.data()),static_cast<std::streamsize>(offsets.size()*sizeof(uint64_t)));
+    return static_cast<bool>(o);
+}
+
+
+inline bool Line_index::load(const std::filesystem::path &idx){
+    std::ifstream in(idx,std::ios::binary);
+    if(!in){return false;}
+
+    char     m[sizeof(magic)];
+    uint64_t h[5];
+    char     c[8];
+    in.read(m,sizeof(m));
+    in.read(reinterpret_cast<char*>(h),sizeof(h));
+    in.read(c,sizeof(c));
+    if(!in || std::memcmp(m,magic,sizeof(magic))!=0 || h[4]==0){return false;}
+
+    std::vector<uint64_t> o(h[4]);
+    in.read(reinterpret_cast<char*>(o.data()),static_cast<std::streamsize>(o.size()*sizeof(uint64_t)));
+    if(!in){return false;}
+
+    step      = static_cast<size_t>(h[0]);
+    file_size = h[1];
+    mtime     = static_cast<int64_t>(h[2]);
+    lines     = static_cast<size_t>(h[3]);
+    endl      = c[0];
+    quoted    = c[1]!=0;
+    quote     = c[2];
+    offsets   = std::move(o);
+    return true;
+}
+
+
+inline Line_index Line_index::get(const std::filesystem::path &p, std::string_view buffer, size_t step_, char endl_, bool quoted_, char quote_){
+    const std::filesystem::path idx = sidecar(p);
+    Line_index x;
+    if(x.load(idx) && x.matches(p,step_,endl_,quoted_,quote_) && x.file_size==buffer.size()){return x;}
+
+    x = build(p,buffer,step_,endl_,quoted_,quote_);
+    x.save(idx); //only a cache
+    return x;
+}
+
+
+}
+#endif // CSV_LINE_INDEX_HPP
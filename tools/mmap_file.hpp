@@ -0,0 +1,119 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_MMAP_FILE_HPP
+#define CSV_MMAP_FILE_HPP
+
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define CSV_HAS_MMAP 1
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#else
+    #define CSV_HAS_MMAP 0
+#endif
+
+
+namespace csv{
+
+//USAGE :
+//csv::Mmap_file f("something.tsv"); //map the whole file read only
+//std::string_view v = f.view();     //valid until f is destroyed
+//
+//NOTE : an empty file is not mapped, view() returns an empty string_view
+
+class Mmap_file{
+public:
+    Mmap_file()=default;
+    explicit Mmap_file(const std::filesystem::path &p){open(p);}
+    ~Mmap_file(){close();}
+
+    Mmap_file(const Mmap_file&)=delete;
+    Mmap_file& operator=(const Mmap_file&)=delete;
+
+    Mmap_file(Mmap_file &&o)noexcept:data(o.data),size(o.size){o.data=nullptr; o.size=0;}
+    Mmap_file& operator=(Mmap_file &&o)noexcept{
+        if(this!=&o){close(); data=o.data; size=o.size; o.data=nullptr; o.size=0;}
+        return *this;
+    }
+
+    void open(const std::filesystem::path &p);
+    void close()noexcept;
+
+    std::string_view view()const{return std::string_view(data,size);}
+
+    //kernel hint : the file will be read from the begining to the end
+    void advise_sequential()const{
+        #if CSV_HAS_MMAP
+        if(data!=nullptr){::madvise(const_cast<char*>(data),size,MADV_SEQUENTIAL);}
+        #endif
+    }
+
+private:
+    const char *data=nullptr;
+    size_t      size=0;
+};
+
+
+
+
+inline void Mmap_file::open(const std::filesystem::path &p){
+    close();
+
+    #if CSV_HAS_MMAP
+    int fd = ::open(p.c_str(),O_RDONLY);
+    if(fd<0){throw std::runtime_error("Error in Mmap_file::open, cannot open file. path="+p.generic_string() );}
+
+    struct stat st;
+    if(::fstat(fd,&st)!=0){
+        ::close(fd);
+        throw std::runtime_error("Error in Mmap_file::open, cannot stat file. path="+p.generic_string() );
+    }
+
+    if(st.st_size==0){::close(fd); return;}
+
+    void *m = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); //the mapping keeps its own reference to the file
+    if(m==MAP_FAILED){throw std::runtime_error("Error in Mmap_file::open, cannot map file. path="+p.generic_string() );}
+
+    data = static_cast<const char*>(m);
+    size = static_cast<size_t>(st.st_size);
+    #else
+    throw std::runtime_error("Error in Mmap_file::open, mmap is not supported on this platform. path="+p.generic_string() );
+    #endif
+}
+
+
+inline void Mmap_file::close()noexcept{
+    #if CSV_HAS_MMAP
+    if(data!=nullptr){::munmap(const_cast<char*>(data),size);}
+    #endif
+    data=nullptr;
+    size=0;
+}
+
+
+}
+#endif // CSV_MMAP_FILE_HPP
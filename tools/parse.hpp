@@ -0,0 +1,338 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_PARSE_HPP
+#define CSV_PARSE_HPP
+
+#include <bit>
+#include <cfloat>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+
+namespace csv{
+namespace parse{
+
+//USAGE :
+//int64_t i; double d; bool b; std::chrono::sys_days day; std::chrono::sys_time<std::chrono::milliseconds> t;
+//csv::parse::integer  ("-42", i);                     //returns false if the whole token is not a number
+//csv::parse::floating ("3.25e2", d);
+//csv::parse::boolean  ("true", b);                    //1 0 true false, any case
+//csv::parse::date     ("2024-02-29", day);
+//csv::parse::timestamp("2024-02-29T13:45:00.250+01:00", t); //also "2024-02-29 13:45:00", Z, date only
+//csv::parse::value    (token, x);                     //one of the above, chosen by the type of x
+//
+//Same syntax as std::from_chars (no locale, no leading spaces, no '+'), but faster on usual tokens :
+//- integer  : 8 digits at a time (SWAR), from_chars beyond 19 digits
+//- floating : up to 19 significant digits and a small power of ten are exact with one multiplication
+//             or division (Clinger fast path). Other tokens (long mantissa, large exponent, inf, nan)
+//             go to std::from_chars, which is an Eisel-Lemire parser in recent standard libraries.
+
+
+
+
+namespace detail{
+
+//8 bytes of s, first char in the low byte
+inline uint64_t load8(const char *s){
+    uint64_t v;
+    std::memcpy(&v,s,8);
+    if constexpr(std::endian::native==std::endian::big){v=__builtin_bswap64(v);}
+    return v;
+}
+
+inline bool is_8digits(uint64_t v){
+    return ((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+
+//v : 8 digits, first digit in the low byte
+inline uint32_t parse_8digits(uint64_t v){
+    constexpr uint64_t mask = 0x000000FF000000FFULL;
+    constexpr uint64_t mul1 = 0x000F424000000064ULL; //100 + (1000000 << 32)
+    constexpr uint64_t mul2 = 0x0000271000000001ULL; //1 + (10000 << 32)
+    v -= 0x3030303030303030ULL;
+    v  = (v*10) + (v>>8);
+    v  = (((v & mask)*mul1) + (((v>>16) & mask)*mul2)) >> 32;
+    return static_cast<uint32_t>(v);
+}
+
+//digits in [p,e) added to w, stops at the first non digit. n : number of digits read
+inline const char* digits(const char *p, const char *e, uint64_t &w, size_t &n){
+    const char *b = p;
+    while(e-p>=8){
+        const uint64_t v = load8(p);
+        if(!is_8digits(v)){break;}
+        w = w*100000000 + parse_8digits(v);
+        p+=8;
+    }
+    for(;p!=e && static_cast<unsigned char>(*p-'0')<10; ++p){w = w*10 + static_cast<unsigned>(*p-'0');}
+    n = static_cast<size_t>(p-b);
+    return p;
+}
+
+template<typename T>
+bool from_chars(std::string_view s, T &x){
+    const char *e = s.data()+s.size();
+    auto r = std::from_chars(s.data(),e,x);
+    return r.ec==std::errc() && r.ptr==e;
+}
+
+//exact powers of ten for the fast path
+template<typename T> struct Float_traits;
+template<> struct Float_traits<double>{
+    static constexpr uint64_t max_mantissa = uint64_t(1)<<53;
+    static constexpr int      max_pow10    = 22;
+    static constexpr double   pow10[] = {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+};
+template<> struct Float_traits<float>{
+    static constexpr uint64_t max_mantissa = uint64_t(1)<<24;
+    static constexpr int      max_pow10    = 10;
+    static constexpr float    pow10[] = {1e0f,1e1f,1e2f,1e3f,1e4f,1e5f,1e6f,1e7f,1e8f,1e9f,1e10f};
+};
+
+//2 digits at s
+inline bool two(const char *s, int &x){
+    const unsigned a = static_cast<unsigned char>(s[0]-'0');
+    const unsigned b = static_cast<unsigned char>(s[1]-'0');
+    x = static_cast<int>(a*10+b);
+    return a<10 && b<10;
+}
+
+}//end detail
+
+
+
+
+template<typename T>
+bool integer(std::string_view s, T &x){
+    static_assert(std::is_integral_v<T> && !std::is_same_v<T,bool>, "csv::parse::integer : T must be an integer");
+    const char *p = s.data();
+    const char *e = p+s.size();
+
+    bool neg = false;
+    if constexpr(std::is_signed_v<T>){
+        if(p!=e && *p=='-'){neg=true; ++p;}
+    }
+    if(p==e || e-p>19)[[unlikely]]{return detail::from_chars(s,x);} //19 digits always fit in uint64_t
+
+    uint64_t w = 0;
+    size_t   n = 0;
+    if(detail::digits(p,e,w,n)!=e){return false;}
+
+    typedef std::make_unsigned_t<T> U;
+    const uint64_t max = static_cast<uint64_t>(std::numeric_limits<T>::max()) + (neg ? 1 : 0);
+    if(w>max){return false;}
+    x = neg ? static_cast<T>(U(0)-static_cast<U>(w)) : static_cast<T>(w);
+    return true;
+}
+
+
+template<typename T>
+bool floating(std::string_view s, T &x){
+    static_assert(std::is_same_v<T,double> || std::is_same_v<T,float>, "csv::parse::floating : T must be double or float");
+    typedef detail::Float_traits<T> F;
+    const char *p = s.data();
+    const char *e = p+s.size();
+
+    const bool neg = (p!=e && *p=='-');
+    if(neg){++p;}
+
+    //mantissa : w * 10^exp10
+    uint64_t w  = 0;
+    size_t   ni = 0;
+    size_t   nf = 0;
+    p = detail::digits(p,e,w,ni);
+    if(p!=e && *p=='.'){p = detail::digits(p+1,e,w,nf);}
+    int64_t exp10 = -static_cast<int64_t>(nf);
+
+    if(p!=e && (*p=='e' || *p=='E') && ni+nf!=0){
+        const char *q = p+1;
+        const bool eneg = (q!=e && *q=='-');
+        if(q!=e && (*q=='-' || *q=='+')){++q;}
+        uint64_t ex = 0;
+        size_t   ne = 0;
+        if(e-q<=4){ //larger exponents : from_chars
+            q = detail::digits(q,e,ex,ne);
+            if(ne!=0){exp10 += eneg ? -static_cast<int64_t>(ex) : static_cast<int64_t>(ex); p=q;}
+        }
+    }
+
+    #if FLT_EVAL_METHOD==0
+    if(p==e && ni+nf!=0 && ni+nf<=19 && w<=F::max_mantissa && exp10>=-F::max_pow10 && exp10<=F::max_pow10)[[likely]]{
+        T r = static_cast<T>(w);
+        r = exp10<0 ? r/F::pow10[-exp10] : r*F::pow10[exp10];
+        x = neg ? -r : r;
+        return true;
+    }
+    #endif
+    return detail::from_chars(s,x);
+}
+
+
+inline bool boolean(std::string_view s, bool &x){
+    if(s.size()==1){
+        if(s[0]=='1'){x=true;  return true;}
+        if(s[0]=='0'){x=false; return true;}
+        return false;
+    }
+    auto is = [&](const char *w){ //case insensitive, w is lower case
+        for(size_t i=0;i<s.size();++i){if((s[i]|0x20)!=w[i]){return false;}}
+        return true;
+    };
+    if(s.size()==4 && is("true" )){x=true;  return true;}
+    if(s.size()==5 && is("false")){x=false; return true;}
+    return false;
+}
+
+
+//YYYY-MM-DD
+inline bool date(std::string_view s, std::chrono::sys_days &x){
+    if(s.size()!=10 || s[4]!='-' || s[7]!='-'){return false;}
+    int y0,y1,m,d;
+    if(!detail::two(s.data(),y0) || !detail::two(s.data()+2,y1) || !detail::two(s.data()+5,m) || !detail::two(s.data()+8,d)){return false;}
+    const std::chrono::year_month_day ymd{std::chrono::year(y0*100+y1),std::chrono::month(static_cast<unsigned>(m)),std::chrono::day(static_cast<unsigned>(d))};
+    if(!ymd.ok()){return false;}
+    x = std::chrono::sys_days(ymd);
+    return true;
+}
+
+
+//YYYY-MM-DD, then optional [T or space]HH:MM:SS[.fraction][Z or +HH:MM or -HH:MM or +HHMM]
+//digits of the fraction beyond the precision of Duration are rounded down, at most 9 digits
+template<typename Duration>
+bool timestamp(std::string_view s, std::chrono::sys_time<Duration> &x){
+    using namespace std::chrono;
+    sys_days day;
+    if(s.size()<10 || !date(s.substr(0,10),day)){return false;}
+    if(s.size()==10){x = floor<Duration>(sys_time<nanoseconds>(day)); return true;}
+
+    const char *p = s.data()+10;
+    const char *e = s.data()+s.size();
+    int h,m,sec;
+    if(e-p<9 || (*p!='T' && *p!=' ') || p[3]!=':' || p[6]!=':'){return false;}
+    if(!detail::two(p+1,h) || !detail::two(p+4,m) || !detail::two(p+7,sec) || h>23 || m>59 || sec>59){return false;}
+    p+=9;
+
+    nanoseconds frac{0};
+    if(p!=e && *p=='.'){
+        uint64_t f = 0;
+        size_t   n = 0;
+        const char *q = detail::digits(p+1,e,f,n);
+        if(n==0 || n>9){return false;}
+        for(size_t i=n;i<9;++i){f*=10;}
+        frac = nanoseconds(static_cast<int64_t>(f));
+        p = q;
+    }
+
+    minutes offset{0};
+    if(p!=e){
+        if(*p=='Z' && p+1==e){
+            ++p;
+        }else if(*p=='+' || *p=='-'){
+            int oh,om;
+            const bool colon = (e-p==6 && p[3]==':');
+            if(!(colon || e-p==5) || !detail::two(p+1,oh) || !detail::two(p+(colon?4:3),om) || oh>23 || om>59){return false;}
+            offset = hours(oh)+minutes(om);
+            if(*p=='-'){offset=-offset;}
+            p=e;
+        }else{
+            return false;
+        }
+    }
+
+    const sys_time<nanoseconds> t = day + hours(h) + minutes(m) + seconds(sec) + frac - offset;
+    x = floor<Duration>(t);
+    return true;
+}
+
+
+
+
+template<typename T> struct is_sys_time : std::false_type{};
+template<typename D> struct is_sys_time<std::chrono::sys_time<D>> : std::true_type{};
+
+template<typename T> struct is_optional : std::false_type{};
+template<typename T> struct is_optional<std::optional<T>> : std::true_type{};
+
+//a type that value can parse
+template<typename T>
+constexpr bool is_parsable_v =
+       std::is_arithmetic_v<T> || is_sys_time<T>::value
+    || std::is_same_v<T,std::string> || std::is_same_v<T,std::string_view>;
+
+
+//parse s into x according to the type of x. std::optional<T> : an empty token is std::nullopt
+//std::string_view points to s
+template<typename T>
+bool value(std::string_view s, T &x){
+    if constexpr(is_optional<T>::value){
+        if(s.empty()){x.reset(); return true;}
+        typename T::value_type v;
+        if(!value(s,v)){return false;}
+        x = std::move(v);
+        return true;
+    }else if constexpr(std::is_same_v<T,bool>){
+        return boolean(s,x);
+    }else if constexpr(std::is_integral_v<T>){
+        return integer(s,x);
+    }else if constexpr(std::is_same_v<T,double> || std::is_same_v<T,float>){
+        return floating(s,x);
+    }else if constexpr(std::is_floating_point_v<T>){
+        return detail::from_chars(s,x);
+    }else if constexpr(std::is_same_v<T,std::chrono::sys_days>){
+        return date(s,x);
+    }else if constexpr(is_sys_time<T>::value){
+        return timestamp(s,x);
+    }else if constexpr(std::is_same_v<T,std::string>){
+        x.assign(s.data(),s.size());
+        return true;
+    }else if constexpr(std::is_same_v<T,std::string_view>){
+        x = s;
+        return true;
+    }else{
+        static_assert(is_parsable_v<T>, "csv::parse::value : T must be arithmetic, bool, std::chrono::sys_days, std::chrono::sys_time, std::string, std::string_view or std::optional of these");
+        return false;
+    }
+}
+
+
+//name of T, for error messages
+template<typename T>
+constexpr const char* type_name(){
+    if constexpr(is_optional<T>::value)                  {return type_name<typename T::value_type>();}
+    else if constexpr(std::is_same_v<T,bool>)            {return "bool";}
+    else if constexpr(std::is_integral_v<T>)             {return "integer";}
+    else if constexpr(std::is_floating_point_v<T>)       {return "floating point";}
+    else if constexpr(std::is_same_v<T,std::chrono::sys_days>){return "date";}
+    else if constexpr(is_sys_time<T>::value)             {return "timestamp";}
+    else                                                 {return "text";}
+}
+
+}//end parse
+}//end csv
+
+#endif // CSV_PARSE_HPP
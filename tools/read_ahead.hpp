@@ -0,0 +1,243 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_READ_AHEAD_HPP
+#define CSV_READ_AHEAD_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define CSV_HAS_PREAD 1
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+#else
+    #define CSV_HAS_PREAD 0
+#endif
+
+
+namespace csv{
+
+//USAGE :
+//csv::Read_ahead r("something.tsv", opt); //starts a thread that fills a ring of buffers with pread
+//std::string_view block;
+//while(r.next(block)){ //blocks in file order, block is valid until the next call to next
+//    ...
+//}
+//
+//With direct=true, the file is opened with O_DIRECT when the platform and the file system allow it,
+//buffers are aligned on 4096 bytes and buffer_size is rounded up to a multiple of 4096.
+//
+//Any source : csv::Read_ahead r(source, opt, name); source(b,n) fills [b,b+n), less than n bytes is the end.
+//It is called by the thread, for example a decompressor (see codec.hpp).
+
+class Read_ahead{
+public:
+    struct Options{
+        size_t buffer_count = 4;
+        size_t buffer_size  = 4<<20;
+        bool   direct       = false;
+    };
+
+    typedef std::function<size_t(char *b, size_t n)> Source;
+
+    Read_ahead(const std::filesystem::path &p, const Options &opt);
+    Read_ahead(Source source_, const Options &opt, std::string name_); //opt.direct is not used
+    ~Read_ahead(){stop();}
+
+    Read_ahead(const Read_ahead&)=delete;
+    Read_ahead& operator=(const Read_ahead&)=delete;
+
+    //releases the previous block, waits for the next one. Returns false at the end of the file.
+    bool next(std::string_view &block);
+
+private:
+    static constexpr size_t alignment = 4096;
+
+    struct Slot{
+        char  *data = nullptr;
+        size_t size = 0;
+        bool   full = false;
+        bool   last = false; //no block after this one
+    };
+
+    std::string              name;
+    Source                   source;
+    int                      fd = -1;
+    size_t                   buffer_size = 0;
+    std::vector<Slot>        slots;
+    size_t                   read_slot = 0;   //next slot to consume
+    bool                     holding   = false; //the consumer holds slots[read_slot-1]
+    bool                     done      = false;
+
+    std::mutex               m;
+    std::condition_variable  cv;
+    bool                     stopping  = false;
+    std::exception_ptr       error;
+    std::thread              thread;
+
+    void run();
+    void stop();
+};
+
+
+
+
+inline Read_ahead::Read_ahead(const std::filesystem::path &p, const Options &opt):name(p.generic_string()){
+    #if CSV_HAS_PREAD
+    bool direct = false;
+    #ifdef O_DIRECT
+    if(opt.direct){
+        fd = ::open(p.c_str(),O_RDONLY|O_DIRECT);
+        direct = (fd>=0);
+    }
+    #endif
+    if(fd<0){fd = ::open(p.c_str(),O_RDONLY);}
+    if(fd<0){throw std::runtime_error("Error in Read_ahead, cannot open file. path="+name );}
+
+    #if defined(POSIX_FADV_SEQUENTIAL)
+    if(!direct){::posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);}
+    #endif
+
+    buffer_size = std::max<size_t>(opt.buffer_size,1);
+    if(direct){buffer_size = (buffer_size+alignment-1)/alignment*alignment;}
+
+    //fill the buffer, a short read is not the end of the file
+    source = [this,offset=size_t(0)](char *b, size_t size) mutable {
+        size_t n=0;
+        while(n<size){
+            ssize_t r = ::pread(fd,b+n,size-n,static_cast<off_t>(offset+n));
+            if(r<0){
+                if(errno==EINTR){continue;}
+                throw std::runtime_error("Error in Read_ahead, cannot read file. path="+name );
+            }
+            if(r==0){break;}
+            n+=static_cast<size_t>(r);
+        }
+        offset+=n;
+        return n;
+    };
+
+    slots.resize(std::max<size_t>(opt.buffer_count,2));
+    for(auto &s:slots){
+        s.data = static_cast<char*>(std::aligned_alloc(alignment,(buffer_size+alignment-1)/alignment*alignment));
+        if(s.data==nullptr){stop(); throw std::bad_alloc();}
+    }
+
+    thread = std::thread([this](){run();});
+    #else
+    (void)opt;
+    throw std::runtime_error("Error in Read_ahead, pread is not supported on this platform. path="+name );
+    #endif
+}
+
+
+inline Read_ahead::Read_ahead(Source source_, const Options &opt, std::string name_):name(std::move(name_)),source(std::move(source_)){
+    buffer_size = std::max<size_t>(opt.buffer_size,1);
+    slots.resize(std::max<size_t>(opt.buffer_count,2));
+    for(auto &s:slots){
+        s.data = static_cast<char*>(std::aligned_alloc(alignment,(buffer_size+alignment-1)/alignment*alignment));
+        if(s.data==nullptr){stop(); throw std::bad_alloc();}
+    }
+    thread = std::thread([this](){run();});
+}
+
+
+inline void Read_ahead::run(){
+    try{
+        for(size_t i=0;;++i){
+            Slot &s = slots[i%slots.size()];
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv.wait(lk,[&](){return stopping || !s.full;});
+                if(stopping){return;}
+            }
+
+            const size_t n = source(s.data,buffer_size);
+
+            {
+                std::lock_guard<std::mutex> lk(m);
+                s.size = n;
+                s.last = (n<buffer_size);
+                s.full = true;
+            }
+            cv.notify_all();
+            if(n<buffer_size){return;}
+        }
+    }catch(...){
+        {
+            std::lock_guard<std::mutex> lk(m);
+            error = std::current_exception();
+        }
+        cv.notify_all();
+    }
+}
+
+
+inline bool Read_ahead::next(std::string_view &block){
+    std::unique_lock<std::mutex> lk(m);
+
+    if(holding){
+        slots[(read_slot+slots.size()-1)%slots.size()].full=false;
+        holding=false;
+        cv.notify_all();
+    }
+    if(done){return false;}
+
+    Slot &s = slots[read_slot];
+    cv.wait(lk,[&](){return s.full || error;});
+    if(error){std::rethrow_exception(error);}
+
+    block    = std::string_view(s.data,s.size);
+    done     = s.last;
+    holding  = true;
+    read_slot= (read_slot+1)%slots.size();
+    return true;
+}
+
+
+inline void Read_ahead::stop(){
+    {
+        std::lock_guard<std::mutex> lk(m);
+        stopping=true;
+    }
+    cv.notify_all();
+    if(thread.joinable()){thread.join();}
+
+    for(auto &s:slots){std::free(s.data); s.data=nullptr;}
+    #if CSV_HAS_PREAD
+    if(fd>=0){::close(fd); fd=-1;}
+    #endif
+}
+
+
+}
+#endif // CSV_READ_AHEAD_HPP
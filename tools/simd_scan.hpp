@@ -0,0 +1,508 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_SIMD_SCAN_HPP
+#define CSV_SIMD_SCAN_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define CSV_SIMD_X86 1
+    #include <immintrin.h>
+    #define CSV_TARGET(x) __attribute__((target(x)))
+    #define CSV_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+    #define CSV_SIMD_X86 0
+    #define CSV_TARGET(x)
+    #define CSV_ALWAYS_INLINE inline
+#endif
+
+
+namespace csv::simd{
+
+//USAGE :
+//std::vector<std::string_view> fields;
+//const char *e = csv::simd::split_line(b, end, '\t', '\n', fields);
+//  fields : the fields of the line starting at b are appended to fields
+//  e      : points to the endl that ends the line, or end if there is no endl
+//
+//An empty line has no field, same as a line with no sep has one field.
+//With max_fields, only the first max_fields fields are appended, the rest of the line is skipped.
+//split_line picks the best kernel for the running cpu (avx512bw, avx2, sse2, scalar).
+//(avx2 and avx512bw kernels also require pclmul)
+//The kernels can also be called directly, they all give the same results.
+//
+//size_t n = csv::simd::count(b, end, '\n'); //number of '\n' in [b,end)
+//
+//--- quoted fields (RFC 4180) ---
+//const char *e = csv::simd::split_line_quoted(b, end, ',', '\n', '"', fields);
+//  same as split_line, but sep and endl between quotes are not structural.
+//  Fields are not unquoted : "a,b" gives the field "a,b" with its quotes.
+//  b must not be inside quotes.
+//
+//--- find ---
+//const char *p = csv::simd::find_any_of(b, end, ',', '\n', '"', '\r');
+//  first char of [b,end) equal to one of the 4 chars, or end. Used to find the fields that need quotes.
+//
+//Each 64 bytes block gives a quote, a sep and an endl bitmask.
+//The in-quote mask is the prefix xor of the quote mask (carry-less multiply by ~0),
+//xored with the state of the previous block, and removed from the sep and endl masks.
+
+
+typedef const char*(*Split_line_fn)(const char *b, const char *e, char sep, char endl, std::vector<std::string_view> &fields, size_t max_fields);
+typedef size_t     (*Count_fn)     (const char *b, const char *e, char c);
+typedef const char*(*Split_line_quoted_fn)(const char *b, const char *e, char sep, char endl, char quote, std::vector<std::string_view> &fields, size_t max_fields);
+typedef const char*(*Find_any_of_fn)(const char *b, const char *e, char c0, char c1, char c2, char c3);
+
+
+//--- scalar (reference) kernel ---
+inline const char* split_line_scalar(const char *b, const char *e, char sep, char endl, std::vector<std::string_view> &fields, size_t max_fields){
+    const char *f = b; //begin of the current field
+    const char *p = b;
+    size_t left = max_fields;
+    for(;p!=e;++p){
+        if(*p==endl){break;}
+        if(*p==sep && left!=0){fields.emplace_back(f,static_cast<size_t>(p-f)); f=p+1; --left;}
+    }
+    if(p!=b && left!=0){fields.emplace_back(f,static_cast<size_t>(p-f));}
+    return p;
+}
+
+inline size_t count_scalar(const char *b, const char *e, char c){
+    size_t r=0;
+    for(;b!=e;++b){r+=(*b==c);}
+    return r;
+}
+
+inline const char* split_line_quoted_scalar(const char *b, const char *e, char sep, char endl, char quote, std::vector<std::string_view> &fields, size_t max_fields){
+    const char *f = b;
+    const char *p = b;
+    size_t left = max_fields;
+    bool in_quote = false;
+    for(;p!=e;++p){
+        if(*p==quote){in_quote=!in_quote; continue;}
+        if(in_quote ){continue;}
+        if(*p==endl ){break;}
+        if(*p==sep && left!=0){fields.emplace_back(f,static_cast<size_t>(p-f)); f=p+1; --left;}
+    }
+    if(p!=b && left!=0){fields.emplace_back(f,static_cast<size_t>(p-f));}
+    return p;
+}
+
+inline const char* find_any_of_scalar(const char *b, const char *e, char c0, char c1, char c2, char c3){
+    for(;b!=e;++b){
+        const char c=*b;
+        if(c==c0 || c==c1 || c==c2 || c==c3){return b;}
+    }
+    return e;
+}
+
+
+namespace detail{
+
+inline unsigned ctz     (uint64_t x){return static_cast<unsigned>(__builtin_ctzll(x));}
+inline unsigned popcount(uint64_t x){return static_cast<unsigned>(__builtin_popcountll(x));}
+
+//Kernel::mask(p,c) : bit i is set if p[i]==c, for i in [0,64)
+template<typename Kernel>
+CSV_ALWAYS_INLINE size_t count_impl(const char *b, const char *e, char c){
+    size_t r=0;
+    while(static_cast<size_t>(e-b)>=64){
+        r+=popcount(Kernel::mask(b,c));
+        b+=64;
+    }
+    return r+count_scalar(b,e,c);
+}
+
+//bit i of the result is the xor of bits [0,i] of x
+inline uint64_t prefix_xor_shift(uint64_t x){
+    x^=x<<1;
+    x^=x<<2;
+    x^=x<<4;
+    x^=x<<8;
+    x^=x<<16;
+    x^=x<<32;
+    return x;
+}
+
+//Kernel::masks(p,a,b,ma,mb) : bit i of ma (resp. mb) is set if p[i]==a (resp. p[i]==b), for i in [0,64)
+template<typename Kernel>
+CSV_ALWAYS_INLINE const char* split_line_impl(const char *b, const char *e, char sep, char endl, std::vector<std::string_view> &fields, size_t max_fields){
+    const char *f = b;
+    const char *p = b;
+    size_t left = max_fields;
+
+    //after max_fields fields, only look for endl
+    auto skip_to_endl=[&](const char *x){
+        x = static_cast<const char*>(std::memchr(x,endl,static_cast<size_t>(e-x)));
+        return x==nullptr ? e : x;
+    };
+    if(left==0){return skip_to_endl(b);}
+
+    while(p!=e){
+        size_t   n = static_cast<size_t>(e-p);
+        uint64_t ms;
+        uint64_t me;
+
+        if(n>=64)[[likely]]{
+            Kernel::masks(p,sep,endl,ms,me);
+        }else{
+            //tail : copy to a block, ignore the padding
+            alignas(64) char tmp[64]={};
+            std::memcpy(tmp,p,n);
+            Kernel::masks(tmp,sep,endl,ms,me);
+            const uint64_t valid = (uint64_t(1)<<n)-1;
+            ms&=valid;
+            me&=valid;
+        }
+
+        if(me!=0){ms &= (me & (~me+1))-1;} //keep separators before the first endl
+
+        while(ms!=0){
+            const char *x = p+ctz(ms);
+            fields.emplace_back(f,static_cast<size_t>(x-f));
+            f=x+1;
+            ms&=ms-1;
+            if(--left==0){return skip_to_endl(f);}
+        }
+
+        if(me!=0){
+            const char *x = p+ctz(me);
+            if(x!=b){fields.emplace_back(f,static_cast<size_t>(x-f));}
+            return x;
+        }
+
+        p = (n>=64 ? p+64 : e);
+    }
+
+    if(e!=b){fields.emplace_back(f,static_cast<size_t>(e-f));}
+    return e;
+}
+
+
+//Kernel::prefix_xor(x) : see prefix_xor_shift
+template<typename Kernel>
+CSV_ALWAYS_INLINE const char* split_line_quoted_impl(const char *b, const char *e, char sep, char endl, char quote, std::vector<std::string_view> &fields, size_t max_fields){
+    const char *f = b;
+    const char *p = b;
+    uint64_t carry = 0; //all ones if the previous block ends inside quotes
+    size_t left = max_fields; //after max_fields fields, only look for endl
+
+    while(p!=e){
+        size_t   n = static_cast<size_t>(e-p);
+        uint64_t mq;
+        uint64_t ms;
+        uint64_t me;
+
+        if(n>=64)[[likely]]{
+            mq = Kernel::mask(p,quote);
+            Kernel::masks(p,sep,endl,ms,me);
+        }else{
+            alignas(64) char tmp[64]={};
+            std::memcpy(tmp,p,n);
+            const uint64_t valid = (uint64_t(1)<<n)-1;
+            mq = Kernel::mask(tmp,quote) & valid;
+            Kernel::masks(tmp,sep,endl,ms,me);
+            ms&=valid;
+            me&=valid;
+        }
+
+        const uint64_t in_quote = Kernel::prefix_xor(mq) ^ carry;
+        carry = static_cast<uint64_t>( static_cast<int64_t>(in_quote) >> 63 );
+        ms &= ~in_quote;
+        me &= ~in_quote;
+
+        if(me!=0){ms &= (me & (~me+1))-1;}
+
+        while(ms!=0 && left!=0){
+            const char *x = p+ctz(ms);
+            fields.emplace_back(f,static_cast<size_t>(x-f));
+            f=x+1;
+            ms&=ms-1;
+            --left;
+        }
+
+        if(me!=0){
+            const char *x = p+ctz(me);
+            if(x!=b && left!=0){fields.emplace_back(f,static_cast<size_t>(x-f));}
+            return x;
+        }
+
+        p = (n>=64 ? p+64 : e);
+    }
+
+    if(e!=b && left!=0){fields.emplace_back(f,static_cast<size_t>(e-f));}
+    return e;
+}
+
+
+#if CSV_SIMD_X86
+struct Sse2{
+    static inline uint64_t prefix_xor(uint64_t x){return prefix_xor_shift(x);}
+
+    CSV_TARGET("sse2") static inline uint64_t mask(const char *p, char c){
+        const __m128i vc = _mm_set1_epi8(c);
+        uint64_t m=0;
+        for(unsigned i=0;i<4;++i){
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+16*i));
+            m |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x,vc))))<<(16*i);
+        }
+        return m;
+    }
+
+    CSV_TARGET("sse2") static inline void masks(const char *p, char a, char b, uint64_t &ma, uint64_t &mb){
+        const __m128i va = _mm_set1_epi8(a);
+        const __m128i vb = _mm_set1_epi8(b);
+        ma=0;
+        mb=0;
+        for(unsigned i=0;i<4;++i){
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+16*i));
+            ma |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x,va))))<<(16*i);
+            mb |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x,vb))))<<(16*i);
+        }
+    }
+};
+
+struct Avx2{
+    CSV_TARGET("avx2,pclmul") static inline uint64_t prefix_xor(uint64_t x){
+        return static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0,static_cast<int64_t>(x)),_mm_set1_epi8(-1),0)));
+    }
+
+    CSV_TARGET("avx2") static inline uint64_t mask(const char *p, char c){
+        const __m256i vc = _mm256_set1_epi8(c);
+        const __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p+32));
+        return  uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x0,vc))))
+             | (uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x1,vc))))<<32);
+    }
+
+    CSV_TARGET("avx2") static inline void masks(const char *p, char a, char b, uint64_t &ma, uint64_t &mb){
+        const __m256i va = _mm256_set1_epi8(a);
+        const __m256i vb = _mm256_set1_epi8(b);
+        const __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p+32));
+        ma =  uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x0,va))))
+           | (uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x1,va))))<<32);
+        mb =  uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x0,vb))))
+           | (uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x1,vb))))<<32);
+    }
+};
+
+struct Avx512{
+    CSV_TARGET("avx512f,avx512bw,pclmul") static inline uint64_t prefix_xor(uint64_t x){
+        return static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_set_epi64x(0,static_cast<int64_t>(x)),_mm_set1_epi8(-1),0)));
+    }
+
+    CSV_TARGET("avx512f,avx512bw") static inline uint64_t mask(const char *p, char c){
+        return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(p),_mm512_set1_epi8(c));
+    }
+
+    CSV_TARGET("avx512f,avx512bw") static inline void masks(const char *p, char a, char b, uint64_t &ma, uint64_t &mb){
+        const __m512i x = _mm512_loadu_si512(p);
+        ma = _mm512_cmpeq_epi8_mask(x,_mm512_set1_epi8(a));
+        mb = _mm512_cmpeq_epi8_mask(x,_mm512_set1_epi8(b));
+    }
+};
+
+//bit i is set if p[i] is one of the 4 chars of v, for i in [0,16) (resp. [0,32))
+CSV_TARGET("sse2") CSV_ALWAYS_INLINE unsigned any_of4_sse2(const char *p, const __m128i *v){
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x,v[0]),_mm_cmpeq_epi8(x,v[1])),_mm_or_si128(_mm_cmpeq_epi8(x,v[2]),_mm_cmpeq_epi8(x,v[3])));
+    return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+
+CSV_TARGET("avx2") CSV_ALWAYS_INLINE unsigned any_of4_avx2(const char *p, const __m256i *v){
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x,v[0]),_mm256_cmpeq_epi8(x,v[1])),_mm256_or_si256(_mm256_cmpeq_epi8(x,v[2]),_mm256_cmpeq_epi8(x,v[3])));
+    return static_cast<unsigned>(_mm256_movemask_epi8(m));
+}
+#endif
+
+}//end detail
+
+
+#if CSV_SIMD_X86
+CSV_TARGET("sse2")
+inline const char* split_line_sse2(const char *b, const char *e, char sep, char endl, std::vector<std::string_view> &fields, size_t max_fields){
+    return detail::split_line_impl<detail::Sse2>(b,e,sep,endl,fields,max_fields);
+}
+
+CSV_TARGET("avx2")
+inline const char* split_line_avx2(const char *b, const char *e, char sep, char endl, std::vector<std::string_view> &fields, size_t max_fields){
+    return detail::split_line_impl<detail::Avx2>(b,e,sep,endl,fields,max_fields);
+}
+
+CSV_TARGET("avx512f,avx512bw")
+inline const char* split_line_avx512(const char *b, const char *e, char sep, char endl, std::vector<std::string_view> &fields, size_t max_fields){
+    return detail::split_line_impl<detail::Avx512>(b,e,sep,endl,fields,max_fields);
+}
+
+CSV_TARGET("sse2")
+inline const char* split_line_quoted_sse2(const char *b, const char *e, char sep, char endl, char quote, std::vector<std::string_view> &fields, size_t max_fields){
+    return detail::split_line_quoted_impl<detail::Sse2>(b,e,sep,endl,quote,fields,max_fields);
+}
+
+CSV_TARGET("avx2,pclmul")
+inline const char* split_line_quoted_avx2(const char *b, const char *e, char sep, char endl, char quote, std::vector<std::string_view> &fields, size_t max_fields){
+    return detail::split_line_quoted_impl<detail::Avx2>(b,e,sep,endl,quote,fields,max_fields);
+}
+
+CSV_TARGET("avx512f,avx512bw,pclmul")
+inline const char* split_line_quoted_avx512(const char *b, const char *e, char sep, char endl, char quote, std::vector<std::string_view> &fields, size_t max_fields){
+    return detail::split_line_quoted_impl<detail::Avx512>(b,e,sep,endl,quote,fields,max_fields);
+}
+
+CSV_TARGET("sse2")              inline size_t count_sse2  (const char *b, const char *e, char c){return detail::count_impl<detail::Sse2  >(b,e,c);}
+CSV_TARGET("avx2")              inline size_t count_avx2  (const char *b, const char *e, char c){return detail::count_impl<detail::Avx2  >(b,e,c);}
+CSV_TARGET("avx512f,avx512bw")  inline size_t count_avx512(const char *b, const char *e, char c){return detail::count_impl<detail::Avx512>(b,e,c);}
+
+//fields are short : 16 (sse2) or 32 (avx2) bytes per step, the last step overlaps the previous one
+CSV_TARGET("sse2")
+inline const char* find_any_of_sse2(const char *b, const char *e, char c0, char c1, char c2, char c3){
+    const size_t n = static_cast<size_t>(e-b);
+    if(n<16){return find_any_of_scalar(b,e,c0,c1,c2,c3);}
+
+    const __m128i v[4]={_mm_set1_epi8(c0), _mm_set1_epi8(c1), _mm_set1_epi8(c2), _mm_set1_epi8(c3)};
+    const char *p=b;
+    for(;e-p>=16;p+=16){
+        if(unsigned m=detail::any_of4_sse2(p,v)){return p+__builtin_ctz(m);}
+    }
+    if(p==e){return e;}
+    p=e-16;
+    if(unsigned m=detail::any_of4_sse2(p,v)){return p+__builtin_ctz(m);}
+    return e;
+}
+
+CSV_TARGET("avx2")
+inline const char* find_any_of_avx2(const char *b, const char *e, char c0, char c1, char c2, char c3){
+    const size_t n = static_cast<size_t>(e-b);
+    if(n<32){return find_any_of_sse2(b,e,c0,c1,c2,c3);}
+
+    const __m256i v[4]={_mm256_set1_epi8(c0), _mm256_set1_epi8(c1), _mm256_set1_epi8(c2), _mm256_set1_epi8(c3)};
+    const char *p=b;
+    for(;e-p>=32;p+=32){
+        if(unsigned m=detail::any_of4_avx2(p,v)){return p+__builtin_ctz(m);}
+    }
+    if(p==e){return e;}
+    p=e-32;
+    if(unsigned m=detail::any_of4_avx2(p,v)){return p+__builtin_ctz(m);}
+    return e;
+}
+#endif
+
+
+//--- runtime dispatch ---
+enum class Isa{scalar, sse2, avx2, avx512};
+
+inline Isa best_isa(){
+    #if CSV_SIMD_X86
+    __builtin_cpu_init();
+    const bool pclmul = __builtin_cpu_supports("pclmul");
+    if(pclmul && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")){return Isa::avx512;}
+    if(pclmul && __builtin_cpu_supports("avx2")){return Isa::avx2;}
+    if(__builtin_cpu_supports("sse2")){return Isa::sse2;}
+    #endif
+    return Isa::scalar;
+}
+
+//returns the kernel for isa, or the scalar kernel if isa is not compiled in
+inline Split_line_fn split_line_kernel(Isa isa){
+    #if CSV_SIMD_X86
+    switch(isa){
+        case Isa::avx512 : return &split_line_avx512;
+        case Isa::avx2   : return &split_line_avx2;
+        case Isa::sse2   : return &split_line_sse2;
+        case Isa::scalar : break;
+    }
+    #else
+    (void)isa;
+    #endif
+    return &split_line_scalar;
+}
+
+inline Count_fn count_kernel(Isa isa){
+    #if CSV_SIMD_X86
+    switch(isa){
+        case Isa::avx512 : return &count_avx512;
+        case Isa::avx2   : return &count_avx2;
+        case Isa::sse2   : return &count_sse2;
+        case Isa::scalar : break;
+    }
+    #else
+    (void)isa;
+    #endif
+    return &count_scalar;
+}
+
+inline Split_line_quoted_fn split_line_quoted_kernel(Isa isa){
+    #if CSV_SIMD_X86
+    switch(isa){
+        case Isa::avx512 : return &split_line_quoted_avx512;
+        case Isa::avx2   : return &split_line_quoted_avx2;
+        case Isa::sse2   : return &split_line_quoted_sse2;
+        case Isa::scalar : break;
+    }
+    #else
+    (void)isa;
+    #endif
+    return &split_line_quoted_scalar;
+}
+
+//avx512 uses the avx2 kernel : fields are short
+inline Find_any_of_fn find_any_of_kernel(Isa isa){
+    #if CSV_SIMD_X86
+    switch(isa){
+        case Isa::avx512 :
+        case Isa::avx2   : return &find_any_of_avx2;
+        case Isa::sse2   : return &find_any_of_sse2;
+        case Isa::scalar : break;
+    }
+    #else
+    (void)isa;
+    #endif
+    return &find_any_of_scalar;
+}
+
+inline const char* split_line(const char *b, const char *e, char sep, char endl, std::vector<std::string_view> &fields, size_t max_fields=SIZE_MAX){
+    static const Split_line_fn fn = split_line_kernel(best_isa());
+    return fn(b,e,sep,endl,fields,max_fields);
+}
+
+inline const char* split_line_quoted(const char *b, const char *e, char sep, char endl, char quote, std::vector<std::string_view> &fields, size_t max_fields=SIZE_MAX){
+    static const Split_line_quoted_fn fn = split_line_quoted_kernel(best_isa());
+    return fn(b,e,sep,endl,quote,fields,max_fields);
+}
+
+inline size_t count(const char *b, const char *e, char c){
+    static const Count_fn fn = count_kernel(best_isa());
+    return fn(b,e,c);
+}
+
+inline const char* find_any_of(const char *b, const char *e, char c0, char c1, char c2, char c3){
+    if(e-b<16){return find_any_of_scalar(b,e,c0,c1,c2,c3);} //not worth an indirect call
+    static const Find_any_of_fn fn = find_any_of_kernel(best_isa());
+    return fn(b,e,c0,c1,c2,c3);
+}
+
+
+}
+#endif // CSV_SIMD_SCAN_HPP
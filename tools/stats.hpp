@@ -0,0 +1,123 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_STATS_HPP
+#define CSV_STATS_HPP
+
+#include "alloc_counter.hpp"
+
+#include <chrono>
+#include <functional>
+
+
+namespace csv{
+
+//USAGE :
+//csv::Stats s;
+//s.progress_lines = 1000000;                       //optional, throttled progress
+//s.at_progress = [](const csv::Progress &p){...};
+//
+//reader.stats = &s;   //or writer.stats = &s;
+//reader.read("something.tsv");
+//s.lines, s.bytes, s.parser_seconds(), s.callback_seconds() ...
+//
+//Csv_reader : counters are reset by each read, and are complete when read returns.
+//Csv_writer : counters are reset by set_write, and are complete when close returns.
+//When stats is nullptr (default), the reader parses with a copy of its loop without any measure.
+
+
+struct Progress{
+    size_t offset;       //bytes of the data lines processed so far
+    size_t lines;
+    double seconds;      //since the start
+    double mb_per_s;
+    double lines_per_s;
+};
+
+
+class Stats{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    size_t bytes          = 0; //data lines, endl included
+    size_t lines          = 0; //data lines
+    size_t fields         = 0; //fields split
+    size_t fields_skipped = 0; //reader : columns given to no function (not split thanks to projection, or not registered)
+    size_t lines_filtered = 0; //reader : lines skipped by Csv_reader::add_filter, included in lines
+    size_t errors         = 0; //reader : lines in error, see Csv_reader::on_error, included in lines
+    size_t allocations    = 0; //calls to operator new, see alloc_counter.hpp
+    Clock::duration elapsed   {0};
+    Clock::duration callbacks {0}; //reader : time in the user functions (at_token, columns, at_row, at_batch, at_line)
+
+    //at_progress is called every progress_lines lines, or every progress_bytes bytes (0 : never)
+    size_t progress_lines = 0;
+    size_t progress_bytes = 0;
+    std::function<void(const Progress&)> at_progress;
+
+    double seconds         ()const{return std::chrono::duration<double>(elapsed).count();}
+    double callback_seconds()const{return std::chrono::duration<double>(callbacks).count();}
+    double parser_seconds  ()const{return seconds()-callback_seconds();} //everything but callbacks : I/O, split, hooks of the library
+
+    //reset the counters, keep the progress settings
+    void start(){
+        bytes=0; lines=0; fields=0; fields_skipped=0; lines_filtered=0; errors=0; allocations=0;
+        elapsed   = Clock::duration(0);
+        callbacks = Clock::duration(0);
+        t0        = Clock::now();
+        alloc0    = allocation_count().load(std::memory_order_relaxed);
+        next_lines= progress_lines;
+        next_bytes= progress_bytes;
+    }
+
+    void stop(){
+        elapsed     = Clock::now()-t0;
+        allocations = allocation_count().load(std::memory_order_relaxed)-alloc0;
+    }
+
+    void add_line(size_t line_bytes, size_t line_fields, size_t skipped){
+        bytes+=line_bytes;
+        ++lines;
+        fields+=line_fields;
+        fields_skipped+=skipped;
+        if(at_progress && ((progress_lines!=0 && lines>=next_lines) || (progress_bytes!=0 && bytes>=next_bytes)))[[unlikely]]{
+            progress();
+        }
+    }
+
+    void add_bytes(size_t n){bytes+=n;}
+
+private:
+    Clock::time_point t0;
+    size_t alloc0     = 0;
+    size_t next_lines = 0;
+    size_t next_bytes = 0;
+
+    void progress(){
+        while(progress_lines!=0 && next_lines<=lines){next_lines+=progress_lines;}
+        while(progress_bytes!=0 && next_bytes<=bytes){next_bytes+=progress_bytes;}
+
+        const double s = std::chrono::duration<double>(Clock::now()-t0).count();
+        const double d = s>0 ? s : 1e-9;
+        at_progress(Progress{bytes,lines,s,static_cast<double>(bytes)/(1<<20)/d,static_cast<double>(lines)/d});
+    }
+};
+
+}
+
+#endif // CSV_STATS_HPP
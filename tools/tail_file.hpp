@@ -0,0 +1,256 @@
+/*
+Copyright (C) 2024 Pierre BLAVY
+
+This program (csv) is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program; if not, write to the Free Software Foundation,
+Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef CSV_TAIL_FILE_HPP
+#define CSV_TAIL_FILE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define CSV_HAS_TAIL_POSIX 1
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #include <cerrno>
+#else
+    #define CSV_HAS_TAIL_POSIX 0
+    #include <fstream>
+#endif
+
+#if defined(__linux__) && __has_include(<sys/inotify.h>)
+    #define CSV_HAS_INOTIFY 1
+    #include <sys/inotify.h>
+    #include <poll.h>
+#else
+    #define CSV_HAS_INOTIFY 0
+#endif
+
+
+namespace csv{
+
+//USAGE :
+//csv::Tail_file t("growing.tsv");
+//char buf[1<<16];
+//size_t n;
+//for(;;){
+//    auto s = t.read(buf,sizeof(buf),n);
+//    if(s==csv::Tail_file::Status::data   ){...buf[0..n) follows the previous bytes...}
+//    if(s==csv::Tail_file::Status::restart){...the file was truncated or replaced : forget everything, next reads start at offset 0...}
+//    if(s==csv::Tail_file::Status::none   ){t.wait(std::chrono::milliseconds(500));}
+//}
+//
+//Rotation (the path now names another file) : the end of the old file is read first, then restart.
+//A missing file is not an error : read returns none until it exists.
+//wait uses inotify on linux, otherwise it sleeps.
+
+class Tail_file{
+public:
+    enum class Status{
+        none,    //nothing new
+        data,    //n bytes appended after offset()-n
+        restart  //truncated or replaced, the next read starts at offset 0
+    };
+
+    explicit Tail_file(const std::filesystem::path &p):path_(p){}
+    ~Tail_file(){close();}
+
+    Tail_file(const Tail_file&)=delete;
+    Tail_file& operator=(const Tail_file&)=delete;
+
+    Status read(char *buf, size_t max, size_t &n);
+    void   wait(std::chrono::milliseconds timeout);
+
+    const std::filesystem::path& path()const{return path_;}
+    uint64_t offset()const{return pos;} //bytes read so far in the current file
+
+private:
+    std::filesystem::path path_;
+    uint64_t pos    = 0;
+    bool     opened = false; //a file was opened before : opening another one is a restart
+
+    #if CSV_HAS_TAIL_POSIX
+    int      fd  = -1;
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    #endif
+
+    #if CSV_HAS_INOTIFY
+    int notify_fd = -1;
+    int watch     = -1;
+    void add_watch();
+    #endif
+
+    bool open(); //false if the file doesn't exist
+    void close()noexcept;
+};
+
+
+
+
+#if CSV_HAS_TAIL_POSIX
+
+inline bool Tail_file::open(){
+    fd = ::open(path_.c_str(),O_RDONLY|O_CLOEXEC);
+    if(fd<0){
+        if(errno==ENOENT){return false;}
+        throw std::runtime_error("Error in Tail_file, cannot open file. path="+path_.generic_string() );
+    }
+    struct stat s;
+    if(::fstat(fd,&s)!=0){
+        close();
+        throw std::runtime_error("Error in Tail_file, cannot stat file. path="+path_.generic_string() );
+    }
+    dev = static_cast<uint64_t>(s.st_dev);
+    ino = static_cast<uint64_t>(s.st_ino);
+    pos = 0;
+    #if CSV_HAS_INOTIFY
+    add_watch();
+    #endif
+    return true;
+}
+
+
+inline void Tail_file::close()noexcept{
+    if(fd>=0){::close(fd); fd=-1;}
+    #if CSV_HAS_INOTIFY
+    if(notify_fd>=0){::close(notify_fd); notify_fd=-1; watch=-1;}
+    #endif
+}
+
+
+inline Tail_file::Status Tail_file::read(char *buf, size_t max, size_t &n){
+    n=0;
+    if(fd<0){
+        if(!open()){return Status::none;}
+        if(opened){return Status::restart;}
+        opened=true;
+    }
+
+    struct stat s;
+    if(::fstat(fd,&s)!=0){
+        throw std::runtime_error("Error in Tail_file, cannot stat file. path="+path_.generic_string() );
+    }
+    if(static_cast<uint64_t>(s.st_size)<pos){
+        pos=0;
+        return Status::restart;
+    }
+
+    ssize_t r;
+    do{r = ::pread(fd,buf,max,static_cast<off_t>(pos));}while(r<0 && errno==EINTR);
+    if(r<0){
+        throw std::runtime_error("Error in Tail_file, cannot read file. path="+path_.generic_string() );
+    }
+    if(r>0){
+        n = static_cast<size_t>(r);
+        pos+=n;
+        return Status::data;
+    }
+
+    //end of this file : is the path still the same file ?
+    struct stat sp;
+    const bool same = ::stat(path_.c_str(),&sp)==0 && static_cast<uint64_t>(sp.st_dev)==dev && static_cast<uint64_t>(sp.st_ino)==ino;
+    if(!same){
+        close();
+        pos=0;
+        return Status::restart;
+    }
+    return Status::none;
+}
+
+
+#else
+
+inline bool Tail_file::open(){
+    if(!std::filesystem::exists(path_)){return false;}
+    pos = 0;
+    return true;
+}
+
+inline void Tail_file::close()noexcept{}
+
+//no file identity here : only truncation is detected
+inline Tail_file::Status Tail_file::read(char *buf, size_t max, size_t &n){
+    n=0;
+    if(!opened){
+        if(!open()){return Status::none;}
+        opened=true;
+    }
+
+    std::error_code ec;
+    const uint64_t size = std::filesystem::file_size(path_,ec);
+    if(ec){return Status::none;}
+    if(size<pos){
+        pos=0;
+        return Status::restart;
+    }
+    if(size==pos){return Status::none;}
+
+    std::ifstream in(path_,std::ios::binary);
+    in.seekg(static_cast<std::streamoff>(pos));
+    in.read(buf,static_cast<std::streamsize>(max));
+    n = static_cast<size_t>(in.gcount());
+    pos+=n;
+    return n!=0 ? Status::data : Status::none;
+}
+
+#endif
+
+
+
+
+#if CSV_HAS_INOTIFY
+
+inline void Tail_file::add_watch(){
+    if(notify_fd>=0){::close(notify_fd); watch=-1;}
+    notify_fd = ::inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    if(notify_fd<0){return;} //wait sleeps
+    watch = ::inotify_add_watch(notify_fd,path_.c_str(),IN_MODIFY|IN_ATTRIB|IN_CLOSE_WRITE|IN_MOVE_SELF|IN_DELETE_SELF);
+}
+
+
+inline void Tail_file::wait(std::chrono::milliseconds timeout){
+    if(notify_fd<0 || watch<0){
+        std::this_thread::sleep_for(timeout);
+        return;
+    }
+
+    pollfd p{notify_fd,POLLIN,0};
+    if(::poll(&p,1,static_cast<int>(timeout.count()))>0){
+        //drain the events : read looks at the file anyway
+        alignas(inotify_event) char events[4096];
+        while(::read(notify_fd,events,sizeof(events))>0){}
+    }
+}
+
+#else
+
+inline void Tail_file::wait(std::chrono::milliseconds timeout){
+    std::this_thread::sleep_for(timeout);
+}
+
+#endif
+
+
+}
+#endif // CSV_TAIL_FILE_HPP
@@ -24,24 +24,68 @@ Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 //  https://stackoverflow.com/questions/216823/how-to-trim-a-stdstring
 
 #include <algorithm>
-#include <cctype>
+#include <array>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 
 namespace csv{
 
+//ASCII whitespace : ' ' \t \n \v \f \r, as std::isspace in the "C" locale.
+//A table lookup : no locale, no function call per byte
+namespace detail{
+    inline constexpr std::array<bool,256> space_table = [](){
+        std::array<bool,256> t{};
+        for(unsigned char c : {' ','\t','\n','\v','\f','\r'}){t[c]=true;}
+        return t;
+    }();
+}
+
+inline constexpr bool is_space(unsigned char ch){return detail::space_table[ch];}
+
+
+
+//--- string_view : nothing is copied, the bounds of the view move ---
+
+inline constexpr std::string_view trim_left(std::string_view s){
+    size_t i=0;
+    while(i<s.size() && is_space(static_cast<unsigned char>(s[i]))){++i;}
+    return s.substr(i);
+}
+
+inline constexpr std::string_view trim_right(std::string_view s){
+    size_t n=s.size();
+    while(n!=0 && is_space(static_cast<unsigned char>(s[n-1]))){--n;}
+    return s.substr(0,n);
+}
+
+inline constexpr std::string_view trim(std::string_view s){
+    return trim_left(trim_right(s));
+}
+
+//a temporary std::string would convert to a dangling view : auto v = csv::trim(std::string(...)) doesn't compile.
+//Literals and std::string lvalues are not affected
+template<typename S> requires std::is_same_v<S,std::string> std::string_view trim_left (S &&s)=delete;
+template<typename S> requires std::is_same_v<S,std::string> std::string_view trim_right(S &&s)=delete;
+template<typename S> requires std::is_same_v<S,std::string> std::string_view trim      (S &&s)=delete;
+
+
+
+//--- std::string (in place) ---
+
 // trim from start (in place)
 template<typename IsNotSpace>
 inline void trim_left(
     std::string &s,
-    IsNotSpace is_not_space =[](unsigned char ch) {return !std::isspace(ch);}
+    IsNotSpace is_not_space =[](unsigned char ch) {return !is_space(ch);}
 ) {
     s.erase(s.begin(), std::find_if(s.begin(), s.end(),is_not_space ));
 }
 
 
 inline void trim_left(std::string &s) {
-    trim_left(s, [](unsigned char ch) {return !std::isspace(ch);} );
+    s.erase(0, s.size()-trim_left(std::string_view(s)).size());
 }
 
 
@@ -56,7 +100,7 @@ inline void trim_right(std::string &s, IsNotSpace is_not_space) {
 
 
 inline void trim_right(std::string &s) {
-    trim_right(s, [](unsigned char ch) {return !std::isspace(ch);} );
+    s.resize(trim_right(std::string_view(s)).size());
 }
 
 
@@ -72,7 +116,8 @@ inline void trim(  std::string &s, IsNotSpace is_not_space){
 
 
 inline void trim(std::string &s) {
-    trim(s, [](unsigned char ch) {return !std::isspace(ch);} );
+    trim_right(s);
+    trim_left (s);
 }
 
 